@@ -0,0 +1,62 @@
+// Measures the per-message cost of the available log timestamp clocks (see oxen::log::set_clock),
+// both for reading the clock alone and for a complete log statement going through the default
+// pattern into a null sink.
+
+#include <oxen/log.hpp>
+
+#include <chrono>
+#include <iostream>
+
+#include <spdlog/sinks/null_sink.h>
+
+namespace bench {
+
+namespace log = oxen::log;
+using namespace oxen::log::literals;
+
+constexpr int ITERATIONS = 2'000'000;
+
+template <typename F>
+double ns_per_call(F&& f) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < ITERATIONS; i++)
+        f(i);
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / ITERATIONS;
+}
+
+int run() {
+    // A null sink that still runs the pattern formatter, so that we measure the %* flag too.
+    class formatting_null_sink : public spdlog::sinks::base_sink<std::mutex> {
+        void sink_it_(const spdlog::details::log_msg& msg) override {
+            spdlog::memory_buf_t buf;
+            formatter_->format(msg, buf);
+        }
+        void flush_() override {}
+    };
+    log::add_sink(std::make_shared<formatting_null_sink>());
+
+    auto cat = log::Cat("bench");
+
+    for (auto [clock, name] : {std::pair{log::Clock::System, "system"},
+                               std::pair{log::Clock::Coarse, "coarse"},
+                               std::pair{log::Clock::TSC, "tsc"}}) {
+        if (log::set_clock(clock) != clock) {
+            std::cout << "{:>8}: unavailable\n"_format(name);
+            continue;
+        }
+        volatile int64_t sink = 0;
+        auto now_ns = ns_per_call(
+                [&](int) { sink = sink + log::detail::clock_now().time_since_epoch().count(); });
+        auto msg_ns = ns_per_call([&](int i) { log::info(cat, "message {}", i); });
+        std::cout << "{:>8}: {:6.1f} ns/clock read, {:7.1f} ns/log statement\n"_format(
+                name, now_ns, msg_ns);
+    }
+    return 0;
+}
+
+}  // namespace bench
+
+int main() {
+    return bench::run();
+}
@@ -0,0 +1,74 @@
+// Compares the cost of formatting messages with the default log pattern through spdlog's generic
+// pattern_formatter (as used when a sink is given an explicit pattern) against the specialized
+// formatter used when the pattern is left as the default.
+
+#include <oxen/log.hpp>
+
+#include <chrono>
+#include <iostream>
+
+#include <spdlog/details/null_mutex.h>
+#include <spdlog/sinks/base_sink.h>
+
+namespace bench {
+
+namespace log = oxen::log;
+using namespace oxen::log::literals;
+
+constexpr int ITERATIONS = 2'000'000;
+
+// A sink that discards messages after formatting them, and gives access to its formatter.
+class formatting_null_sink : public spdlog::sinks::base_sink<spdlog::details::null_mutex> {
+  public:
+    spdlog::memory_buf_t buf;
+
+    spdlog::formatter& formatter() { return *formatter_; }
+
+  protected:
+    void sink_it_(const spdlog::details::log_msg& msg) override {
+        buf.clear();
+        formatter_->format(msg, buf);
+    }
+    void flush_() override {}
+};
+
+template <typename F>
+double ns_per_call(F&& f) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < ITERATIONS; i++)
+        f(i);
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / ITERATIONS;
+}
+
+int run() {
+    auto cat = log::Cat("bench");
+
+    for (auto [pattern, name] :
+         {std::pair{std::make_optional(log::DEFAULT_PATTERN_MONO), "pattern_formatter"},
+          std::pair{std::optional<std::string>{}, "default formatter"}}) {
+        auto sink = std::make_shared<formatting_null_sink>();
+        log::add_sink(sink, pattern);
+
+        auto sloc = log::detail::spdlog_sloc(source_location::current());
+        std::string payload = "message with a payload of some typical length: 12345";
+        spdlog::details::log_msg msg{
+                log::detail::clock_now(), sloc, "bench", log::Level::info, payload};
+        auto format_ns = ns_per_call([&](int) {
+            sink->buf.clear();
+            sink->formatter().format(msg, sink->buf);
+        });
+        auto msg_ns = ns_per_call([&](int i) { log::info(cat, "message {}", i); });
+
+        std::cout << "{:>18}: {:6.1f} ns/format, {:6.1f} ns/log statement\n"_format(
+                name, format_ns, msg_ns);
+        log::clear_sinks();
+    }
+    return 0;
+}
+
+}  // namespace bench
+
+int main() {
+    return bench::run();
+}
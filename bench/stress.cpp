@@ -0,0 +1,279 @@
+// Tail latency stress test: runs several logging threads against a set of sinks that includes an
+// occasionally very slow one, while another thread keeps reconfiguring the sinks and log level,
+// and reports the distribution of per-call logging latency (which is what matters to an event loop
+// doing the logging) along with throughput.
+
+#include <oxen/log.hpp>
+#include <oxen/log/ring_buffer_sink.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include <spdlog/sinks/basic_file_sink.h>
+#include <spdlog/sinks/null_sink.h>
+
+namespace bench {
+
+namespace log = oxen::log;
+using namespace oxen::log::literals;
+using namespace std::literals;
+using clock = std::chrono::steady_clock;
+
+// HDR-style latency histogram: values (in ns) are counted in log-linear buckets, with 2^SUB_BITS
+// linear buckets for each power of two, so every recorded value is accurate to within ~1.5%
+// regardless of magnitude, in a fixed amount of memory.
+class histogram {
+    static constexpr int SUB_BITS = 6;
+    static constexpr uint64_t SUB_COUNT = 1 << SUB_BITS;
+    std::array<uint64_t, 64 * SUB_COUNT> counts_{};
+    uint64_t total_ = 0;
+    uint64_t max_ = 0;
+
+    static size_t index(uint64_t v) {
+        if (v < SUB_COUNT)
+            return v;
+        int shift = 63 - __builtin_clzll(v) - SUB_BITS;
+        return (shift + 1) * SUB_COUNT + ((v >> shift) - SUB_COUNT);
+    }
+
+    // The highest value that would be counted in bucket `i`
+    static uint64_t highest(size_t i) {
+        uint64_t row = i / SUB_COUNT, sub = i % SUB_COUNT;
+        if (row == 0)
+            return sub;
+        return ((sub + SUB_COUNT + 1) << (row - 1)) - 1;
+    }
+
+  public:
+    void add(uint64_t ns) {
+        counts_[index(ns)]++;
+        total_++;
+        max_ = std::max(max_, ns);
+    }
+
+    void merge(const histogram& h) {
+        for (size_t i = 0; i < counts_.size(); i++)
+            counts_[i] += h.counts_[i];
+        total_ += h.total_;
+        max_ = std::max(max_, h.max_);
+    }
+
+    uint64_t count() const { return total_; }
+    uint64_t max() const { return max_; }
+
+    uint64_t percentile(double p) const {
+        auto want = static_cast<uint64_t>(p / 100.0 * total_);
+        uint64_t seen = 0;
+        for (size_t i = 0; i < counts_.size(); i++) {
+            seen += counts_[i];
+            if (seen > want)
+                return std::min(highest(i), max_);
+        }
+        return max_;
+    }
+};
+
+// Sink that takes `delay` to handle every `every`th message, simulating a sink that hiccups (a
+// slow disk, a blocked pipe, etc.).
+class delayed_sink : public spdlog::sinks::base_sink<std::mutex> {
+    const std::chrono::microseconds delay_;
+    const uint64_t every_;
+    uint64_t count_ = 0;
+
+  public:
+    delayed_sink(std::chrono::microseconds delay, uint64_t every) :
+            delay_{delay}, every_{std::max<uint64_t>(every, 1)} {}
+
+  protected:
+    void sink_it_(const spdlog::details::log_msg& msg) override {
+        spdlog::memory_buf_t buf;
+        formatter_->format(msg, buf);
+        if (++count_ % every_ == 0)
+            std::this_thread::sleep_for(delay_);
+    }
+    void flush_() override {}
+};
+
+struct options {
+    int threads = 4;
+    double rate = 20000;  // per thread; 0 = as fast as possible
+    std::chrono::milliseconds duration = 5s;
+    std::chrono::microseconds delay = 2ms;
+    uint64_t delay_every = 1000;
+    std::string file = "/dev/shm/oxen-log-stress.log";
+    std::vector<std::string> sinks{"null", "delayed", "ring", "file"};
+    bool isolate = false;
+    bool churn = true;
+};
+
+int usage(const char* prog, std::string_view error = "") {
+    if (!error.empty())
+        std::cerr << error << "\n\n";
+    std::cerr << "Usage: " << prog << R"( [OPTIONS]
+
+Options:
+    --threads=N         Number of logging threads (default 4)
+    --rate=R            Messages per second per thread, 0 for as fast as possible (default 20000).
+                        Latencies are measured from each message's scheduled time, so that a stall
+                        also counts against the messages that should have been logged during it.
+    --seconds=S         Test duration (default 5)
+    --delay-us=D        Delay of the delayed sink, in microseconds (default 2000)
+    --delay-every=K     The delayed sink delays on every Kth message (default 1000)
+    --file=PATH         Path of the file sink, ideally on tmpfs
+                        (default /dev/shm/oxen-log-stress.log)
+    --sinks=S1,S2,...   Sinks to use, from: null, delayed, ring, file (default all)
+    --isolate           Add the delayed and file sinks with sink isolation (see log::SinkIsolation)
+    --no-churn          Don't concurrently call add_sink/clear_sinks/reset_level
+)";
+    return 1;
+}
+
+options parse(int argc, char* argv[]) {
+    options o;
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg{argv[i]};
+        auto val = [&](std::string_view prefix) -> std::optional<std::string> {
+            if (arg.substr(0, prefix.size()) == prefix)
+                return std::string{arg.substr(prefix.size())};
+            return std::nullopt;
+        };
+        if (auto v = val("--threads="))
+            o.threads = std::max(1, std::stoi(*v));
+        else if (auto v = val("--rate="))
+            o.rate = std::stod(*v);
+        else if (auto v = val("--seconds="))
+            o.duration = std::chrono::milliseconds{static_cast<int64_t>(std::stod(*v) * 1000)};
+        else if (auto v = val("--delay-us="))
+            o.delay = std::chrono::microseconds{std::stoll(*v)};
+        else if (auto v = val("--delay-every="))
+            o.delay_every = std::stoull(*v);
+        else if (auto v = val("--file="))
+            o.file = *v;
+        else if (auto v = val("--sinks=")) {
+            o.sinks.clear();
+            std::string_view list{*v};
+            while (!list.empty()) {
+                auto comma = list.find(',');
+                o.sinks.emplace_back(list.substr(0, comma));
+                list.remove_prefix(comma == std::string_view::npos ? list.size() : comma + 1);
+            }
+        } else if (arg == "--isolate")
+            o.isolate = true;
+        else if (arg == "--no-churn")
+            o.churn = false;
+        else
+            throw std::invalid_argument{"Invalid argument: {}"_format(arg)};
+    }
+    return o;
+}
+
+int run(int argc, char* argv[]) {
+    options o;
+    try {
+        o = parse(argc, argv);
+    } catch (const std::exception& e) {
+        return usage(argv[0], e.what());
+    }
+
+    std::atomic<uint64_t> ring_bytes = 0;
+    std::vector<std::pair<spdlog::sink_ptr, bool /*isolate*/>> sinks;
+    for (auto& s : o.sinks) {
+        if (s == "null")
+            sinks.emplace_back(std::make_shared<spdlog::sinks::null_sink_mt>(), false);
+        else if (s == "delayed")
+            sinks.emplace_back(std::make_shared<delayed_sink>(o.delay, o.delay_every), o.isolate);
+        else if (s == "ring")
+            sinks.emplace_back(
+                    std::make_shared<log::RingBufferSink>(
+                            100, [&](const std::string& line) { ring_bytes += line.size(); }),
+                    false);
+        else if (s == "file")
+            sinks.emplace_back(
+                    std::make_shared<spdlog::sinks::basic_file_sink_mt>(o.file, true), o.isolate);
+        else
+            return usage(argv[0], "Unknown sink: {}"_format(s));
+    }
+    auto add_sinks = [&] {
+        for (auto& [sink, isolate] : sinks)
+            log::add_sink(
+                    sink,
+                    std::nullopt,
+                    isolate ? std::make_optional<log::SinkIsolation>() : std::nullopt);
+    };
+    add_sinks();
+    log::reset_level(log::Level::info);
+
+    auto cat = log::Cat("stress");
+    std::atomic<bool> done = false;
+    std::vector<histogram> hists(o.threads);
+    std::vector<std::thread> threads;
+    auto start = clock::now();
+    for (int t = 0; t < o.threads; t++) {
+        threads.emplace_back([&, t] {
+            auto& hist = hists[t];
+            const auto interval = o.rate > 0 ? std::chrono::duration_cast<clock::duration>(
+                                                       std::chrono::duration<double>{1 / o.rate})
+                                             : clock::duration{0};
+            auto scheduled = clock::now();
+            for (uint64_t i = 0; !done.load(std::memory_order_relaxed); i++) {
+                if (o.rate > 0) {
+                    scheduled += interval;
+                    auto now = clock::now();
+                    if (scheduled > now)
+                        std::this_thread::sleep_until(scheduled);
+                } else
+                    scheduled = clock::now();
+                log::info(cat, "thread {} message {} with some payload {:.3f}", t, i, i * 0.001);
+                hist.add(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                 clock::now() - scheduled)
+                                 .count());
+            }
+        });
+    }
+
+    // Meanwhile, keep reconfiguring the logging: toggling the level (without changing whether the
+    // test messages are logged) and periodically replacing all the sinks.
+    uint64_t reconfigs = 0;
+    while (clock::now() - start < o.duration) {
+        std::this_thread::sleep_for(10ms);
+        if (!o.churn)
+            continue;
+        log::reset_level(reconfigs % 2 ? log::Level::info : log::Level::debug);
+        if (reconfigs % 10 == 0) {
+            log::clear_sinks();
+            add_sinks();
+        }
+        reconfigs++;
+    }
+    done = true;
+    for (auto& th : threads)
+        th.join();
+    std::chrono::duration<double> elapsed = clock::now() - start;
+    log::clear_sinks();
+
+    histogram all;
+    for (auto& h : hists)
+        all.merge(h);
+
+    std::cout << "{} threads, {:.0f} messages/s total, {} reconfigurations\n"_format(
+            o.threads, all.count() / elapsed.count(), reconfigs);
+    if (std::find(o.sinks.begin(), o.sinks.end(), "ring") != o.sinks.end())
+        std::cout << "ring buffer callback received {} bytes\n"_format(ring_bytes.load());
+    std::cout << "latency (µs):";
+    for (double p : {50.0, 90.0, 99.0, 99.9, 99.99})
+        std::cout << "  p{}={:.1f}"_format(p, all.percentile(p) / 1000.0);
+    std::cout << "  max={:.1f}\n"_format(all.max() / 1000.0);
+    return 0;
+}
+
+}  // namespace bench
+
+int main(int argc, char* argv[]) {
+    return bench::run(argc, argv);
+}
@@ -2,7 +2,10 @@
 
 // Header for actual log statements such as oxen::log::info(...) and so on.
 
+#include <atomic>
+#include <iterator>
 #include <memory>
+#include <typeinfo>
 
 #include <fmt/core.h>
 #include <spdlog/spdlog.h>
@@ -12,7 +15,15 @@
 #include "log/type.hpp"
 #include "log/color.hpp"
 #include "log/internal.hpp"
+#include "log/bytes.hpp"
+#include "log/call_sites.hpp"
 #include "log/catlogger.hpp"
+#include "log/slim.hpp"
+#include "log/spans.hpp"
+#include "log/context.hpp"
+#include "log/isolated_sink.hpp"
+#include "log/format.hpp"
+#include "log/clock.hpp"
 
 namespace oxen::log {
 
@@ -22,224 +33,6 @@ using logger_ptr = std::shared_ptr<spdlog::logger>;
 // master sink stays around forever.
 extern std::shared_ptr<spdlog::sinks::dist_sink_mt> master_sink;
 
-// Function-like logging statements.  These are structs for technical reasons, but are meant to be
-// used as if functions: all of the logging involved happens in the constructor.
-
-/// Log a "trace" log statement.  Use this as if a function, where the first argument is (typically)
-/// a CategoryLogger, the second argument is an fmt pattern, and the rest of the arguments are
-/// arguments for the formatted string.
-template <typename... T>
-struct trace {
-    trace(const logger_ptr& cat_logger,
-          [[maybe_unused]] fmt::format_string<T...> fmt,
-          [[maybe_unused]] T&&... args,
-          [[maybe_unused]] const source_location& location = source_location::current()) {
-#if defined(NDEBUG) && !defined(OXEN_LOGGING_RELEASE_TRACE)
-        // Using [[maybe_unused]] on the *first* ctor argument breaks gcc 8/9
-        (void)cat_logger;
-#else
-        if (cat_logger)
-            cat_logger->log(
-                    detail::spdlog_sloc(location), Level::trace, fmt, std::forward<T>(args)...);
-#endif
-    }
-    trace(const logger_ptr& cat_logger,
-          [[maybe_unused]] const fmt::text_style& sty,
-          [[maybe_unused]] fmt::format_string<T...> fmt,
-          [[maybe_unused]] T&&... args,
-          [[maybe_unused]] const source_location& location = source_location::current()) {
-#if defined(NDEBUG) && !defined(OXEN_LOGGING_RELEASE_TRACE)
-        // Using [[maybe_unused]] on the *first* ctor argument breaks gcc 8/9
-        (void)cat_logger;
-#else
-        if (cat_logger)
-            cat_logger->log(
-                    detail::spdlog_sloc(location),
-                    Level::trace,
-                    "{}",
-                    detail::text_style_wrapper<T...>{sty, fmt, args...});
-#endif
-    }
-};
-/// Log a "debug" log statement.  Use this as if a function, where the first argument is (typically)
-/// a CategoryLogger, the second argument is an fmt pattern, and the rest of the arguments are
-/// arguments for the formatted string.
-template <typename... T>
-struct debug {
-    debug(const logger_ptr& cat_logger,
-          fmt::format_string<T...> fmt,
-          T&&... args,
-          const source_location& location = source_location::current()) {
-        if (cat_logger)
-            cat_logger->log(
-                    detail::spdlog_sloc(location), Level::debug, fmt, std::forward<T>(args)...);
-    }
-    debug(const logger_ptr& cat_logger,
-          const fmt::text_style& sty,
-          fmt::format_string<T...> fmt,
-          T&&... args,
-          const source_location& location = source_location::current()) {
-        if (cat_logger)
-            cat_logger->log(
-                    detail::spdlog_sloc(location),
-                    Level::debug,
-                    "{}",
-                    detail::text_style_wrapper<T...>{sty, fmt, args...});
-    }
-};
-/// Log a "info" log statement.  Use this as if a function, where the first argument is (typically)
-/// a CategoryLogger, the second argument is an fmt pattern, and the rest of the arguments are
-/// arguments for the formatted string.
-template <typename... T>
-struct info {
-    info(const logger_ptr& cat_logger,
-         fmt::format_string<T...> fmt,
-         T&&... args,
-         const source_location& location = source_location::current()) {
-        if (cat_logger)
-            cat_logger->log(
-                    detail::spdlog_sloc(location), Level::info, fmt, std::forward<T>(args)...);
-    }
-    info(const logger_ptr& cat_logger,
-         const fmt::text_style& sty,
-         fmt::format_string<T...> fmt,
-         T&&... args,
-         const source_location& location = source_location::current()) {
-        if (cat_logger)
-            cat_logger->log(
-                    detail::spdlog_sloc(location),
-                    Level::info,
-                    "{}",
-                    detail::text_style_wrapper<T...>{sty, fmt, args...});
-    }
-};
-/// Log a "warning" log statement.  Use this as if a function, where the first argument is
-/// (typically) a CategoryLogger, the second argument is an fmt pattern, and the rest of the
-/// arguments are arguments for the formatted string.
-template <typename... T>
-struct warning {
-    warning(const logger_ptr& cat_logger,
-            fmt::format_string<T...> fmt,
-            T&&... args,
-            const source_location& location = source_location::current()) {
-        if (cat_logger)
-            cat_logger->log(
-                    detail::spdlog_sloc(location), Level::warn, fmt, std::forward<T>(args)...);
-    }
-    warning(const logger_ptr& cat_logger,
-            const fmt::text_style& sty,
-            fmt::format_string<T...> fmt,
-            T&&... args,
-            const source_location& location = source_location::current()) {
-        if (cat_logger)
-            cat_logger->log(
-                    detail::spdlog_sloc(location),
-                    Level::warn,
-                    "{}",
-                    detail::text_style_wrapper<T...>{sty, fmt, args...});
-    }
-};
-/// Log a "error" log statement.  Use this as if a function, where the first argument is (typically)
-/// a CategoryLogger, the second argument is an fmt pattern, and the rest of the arguments are
-/// arguments for the formatted string.
-template <typename... T>
-struct error {
-    error(const logger_ptr& cat_logger,
-          fmt::format_string<T...> fmt,
-          T&&... args,
-          const source_location& location = source_location::current()) {
-        if (cat_logger)
-            cat_logger->log(
-                    detail::spdlog_sloc(location), Level::err, fmt, std::forward<T>(args)...);
-    }
-    error(const logger_ptr& cat_logger,
-          const fmt::text_style& sty,
-          fmt::format_string<T...> fmt,
-          T&&... args,
-          const source_location& location = source_location::current()) {
-        if (cat_logger)
-            cat_logger->log(
-                    detail::spdlog_sloc(location),
-                    Level::err,
-                    "{}",
-                    detail::text_style_wrapper<T...>{sty, fmt, args...});
-    }
-};
-/// Log a "critical" log statement.  Use this as if a function, where the first argument is
-/// (typically) a CategoryLogger, the second argument is an fmt pattern, and the rest of the
-/// arguments are arguments for the formatted string.
-template <typename... T>
-struct critical {
-    critical(
-            const logger_ptr& cat_logger,
-            fmt::format_string<T...> fmt,
-            T&&... args,
-            const source_location& location = source_location::current()) {
-        if (cat_logger)
-            cat_logger->log(
-                    detail::spdlog_sloc(location), Level::critical, fmt, std::forward<T>(args)...);
-    }
-    critical(
-            const logger_ptr& cat_logger,
-            const fmt::text_style& sty,
-            fmt::format_string<T...> fmt,
-            T&&... args,
-            const source_location& location = source_location::current()) {
-        if (cat_logger)
-            cat_logger->log(
-                    detail::spdlog_sloc(location),
-                    Level::critical,
-                    "{}",
-                    detail::text_style_wrapper<T...>{sty, fmt, args...});
-    }
-};
-
-// Deduction guides for our logging function-like structs; these force all arguments given in the
-// constructor to become explicit `T` constructor arguments, which in turn forces the
-// source_location constructor argument to always get defaulted, which is what we want.  (This
-// little deduction guide trick is why we need classes: automatic deduction of generic types won't
-// work with the trailing defaulted value).
-template <typename... T>
-trace(const logger_ptr& cat, fmt::format_string<T...> fmt, T&&... args) -> trace<T...>;
-template <typename... T>
-trace(const logger_ptr& cat, const fmt::text_style& sty, fmt::format_string<T...> fmt, T&&... args)
-        -> trace<T...>;
-
-template <typename... T>
-debug(const logger_ptr& cat, fmt::format_string<T...> fmt, T&&... args) -> debug<T...>;
-template <typename... T>
-debug(const logger_ptr& cat, const fmt::text_style& sty, fmt::format_string<T...> fmt, T&&... args)
-        -> debug<T...>;
-
-template <typename... T>
-info(const logger_ptr& cat, fmt::format_string<T...> fmt, T&&... args) -> info<T...>;
-template <typename... T>
-info(const logger_ptr& cat, const fmt::text_style& sty, fmt::format_string<T...> fmt, T&&... args)
-        -> info<T...>;
-
-template <typename... T>
-warning(const logger_ptr& cat, fmt::format_string<T...> fmt, T&&... args) -> warning<T...>;
-template <typename... T>
-warning(const logger_ptr& cat,
-        const fmt::text_style& sty,
-        fmt::format_string<T...> fmt,
-        T&&... args) -> warning<T...>;
-
-template <typename... T>
-error(const logger_ptr& cat, fmt::format_string<T...> fmt, T&&... args) -> error<T...>;
-template <typename... T>
-error(const logger_ptr& cat, const fmt::text_style& sty, fmt::format_string<T...> fmt, T&&... args)
-        -> error<T...>;
-
-template <typename... T>
-critical(const logger_ptr& cat, fmt::format_string<T...> fmt, T&&... args) -> critical<T...>;
-template <typename... T>
-critical(
-        const logger_ptr& cat,
-        const fmt::text_style& sty,
-        fmt::format_string<T...> fmt,
-        T&&... args) -> critical<T...>;
-
 /// Resets the log level of all existing category loggers, and sets a new default for any created
 /// after this call.  If this has not been called, the default log level of category loggers is
 /// info.
@@ -267,37 +60,99 @@ inline Level get_level(const logger_ptr& cat) {
 /// Gets the log level of a logger by, logger category name.
 Level get_level(std::string cat_name);
 
+/// Sets the sampling settings of a category logger, to emit only a random 1-in-N subset and/or a
+/// rate-limited number of the log statements that pass the category's level check.  For example:
+///
+///     log::set_level(cat, log::Level::trace);
+///     log::set_sampling(cat, {.one_in = 1000});
+///
+/// Sampled-away statements are discarded before anything is formatted.  Throws
+/// std::invalid_argument if given a logger that isn't a category logger.
+void set_sampling(const logger_ptr& cat, Sampling sampling);
+/// Sets the sampling settings of a category logger, by logger category name.
+void set_sampling(std::string cat_name, Sampling sampling);
+
+/// Gets the current sampling settings of a category logger.
+Sampling get_sampling(const logger_ptr& cat);
+/// Gets the current sampling settings of a category logger, by logger category name.
+Sampling get_sampling(std::string cat_name);
+
 /// Flushes the logging sink(s) immediately.
 void flush();
 
 /// The default pattern when no explicit pattern is given and you are using an ansi-color-supporting
 /// log sink.
 const std::string DEFAULT_PATTERN_COLOR =
-        "[%Y-%m-%d %T] [%*] [\x1b[1m%n\x1b[0m:%^%l%$|\x1b[3m%g:%#\x1b[0m] %v";
+        "[%Y-%m-%d %T] [%*] [\x1b[1m%n\x1b[0m:%^%l%$|\x1b[3m%g:%#\x1b[0m] %~%v";
 
 /// The default pattern when no explicit pattern is given and not using an ansi-color-supporting log
 /// sink.
-const std::string DEFAULT_PATTERN_MONO = "[%Y-%m-%d %T] [%*] [%n:%^%l%$|%g:%#] %v";
+const std::string DEFAULT_PATTERN_MONO = "[%Y-%m-%d %T] [%*] [%n:%^%l%$|%g:%#] %~%v";
 
 /// Adds a logging sink to the list of logging sinks where output goes; existing sinks are not
 /// affected.  You *must* call this at least once before log output will go anywhere.
 ///
 /// • type defines the type of sink (file, print, syslog)
 /// • target is the type-dependent "target" of the sink:
-///   - for file sinks, target is the output filename
+///   - for file sinks, target is the output filename.  If oxen-logging is built with
+///     OXEN_LOGGING_COMPRESSED_FILES and the filename ends in `.gz` then the log is written as a
+///     time-indexed, compressed log file (see CompressedFileSink).
 ///   - for print sinks, target can be "", "-", "stdout" for coloured stdout; "stderr" for coloured
 ///     stderr; "nocolor" or "stdout-nocolor" for monochrome stdout; or "stderr-nocolor" for
 ///     monochrome stderr.
 ///   - for syslog sinks, target is an application identifier (e.g. "lokinet")
 /// • pattern is an log output format pattern to use instead of the default.  This is a standard
 ///   spdlog formatting string with custom format '%*' added to print a time-elapsed-since-startup
-///   value.
-void add_sink(
-        Type type, std::string_view target, std::optional<std::string> pattern = std::nullopt);
+///   value, and '%~' to print the fields of any active `scoped_context`s as "[key=value ...] "
+///   (or nothing at all if there are none).
+/// • isolate, if given, wraps the sink in an IsolatedSink so that it gets its own bounded queue and
+///   delivery thread: a slow or stalled sink then cannot hold up logging threads or other sinks.
+///   See SinkIsolation for the available queueing and load-shedding options.  The IsolatedSink
+///   wrapper is returned (nullptr if not isolating) for monitoring it; note that holding on to it
+///   also keeps the sink alive after `clear_sinks`.
+/// • max_message_size, if non-zero, truncates messages longer than this for this sink only (in the
+///   same way as the global `set_max_message_size` does for all sinks).
+std::shared_ptr<IsolatedSink> add_sink(
+        Type type,
+        std::string_view target,
+        std::optional<std::string> pattern = std::nullopt,
+        std::optional<SinkIsolation> isolate = std::nullopt,
+        size_t max_message_size = 0);
 
 /// Adds a manually constructed spdlog sink to the logging sinks.  This is for advanced cases where
 /// the above add_sink won't work.
-void add_sink(spdlog::sink_ptr, std::optional<std::string> pattern = std::nullopt);
+std::shared_ptr<IsolatedSink> add_sink(
+        spdlog::sink_ptr,
+        std::optional<std::string> pattern = std::nullopt,
+        std::optional<SinkIsolation> isolate = std::nullopt,
+        size_t max_message_size = 0);
+
+/// Sets the maximum size of log messages (not including the parts added by the log pattern, such
+/// as the timestamp and category), to bound the memory used by a log statement that accidentally
+/// logs something huge.  Longer messages are cut off and end with "…[truncated N bytes]" instead;
+/// the output beyond the maximum is only counted, not stored.  0 (the default) means no limit.
+/// Individual sinks can also have their own, lower limit; see `add_sink`.
+void set_max_message_size(size_t max);
+
+/// Returns the current global maximum message size (0 for no limit).
+size_t get_max_message_size();
+
+/// Makes a sink (which must also be added with `add_sink`) receive messages of at least `level`
+/// even from categories whose own level filters them out, without changing what other sinks get.
+/// This lets, for example, a RingBufferSink feeding a remote debugging session collect debug
+/// messages without also sending them to the log file.  std::nullopt stops capturing.  Captured
+/// messages go through the sink's isolation wrapper, if it was added with one, like any others, and
+/// sinks can tell them apart from regular messages while they are being delivered (a
+/// RingBufferSink, for instance, does not store them).
+///
+/// While any sink captures a level, log statements at that level (in the categories it is captured
+/// from) have to do a little more work to be filtered out by their category.
+void set_capture_level(const spdlog::sink_ptr& sink, std::optional<Level> level);
+
+/// As above, but capturing different levels from different categories; for instance
+/// `{.categories = {{"p2p", Level::trace}}}` captures just trace messages and up from "p2p".  Empty
+/// levels (no `all` and no categories) stop capturing.
+void set_capture_level(const spdlog::sink_ptr& sink, CaptureLevels levels);
 
 /// Removes all existing log sinks, typically to replace the current log sink.  Note that until
 /// `add_sink` is called after this, logging output will not go anywhere.
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "format.hpp"
+
+#if OXEN_LOGGING_CPLUSPLUS >= 202002L
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <ranges>
+#include <type_traits>
+
+#include <fmt/format.h>
+
+namespace oxen::log {
+
+namespace detail {
+
+    // Encoders used by the formatters below.  `to_hex` writes 2*size characters; `to_b32z` writes
+    // b32z_size(size) characters.  These use SIMD instructions where available.
+    void to_hex(const unsigned char* in, size_t size, char* out);
+    void to_b32z(const unsigned char* in, size_t size, char* out);
+
+    constexpr size_t b32z_size(size_t bytes) {
+        return (bytes * 8 + 4) / 5;
+    }
+
+    template <typename T>
+    concept byte_range = std::ranges::contiguous_range<T> && std::ranges::sized_range<T> &&
+                         sizeof(std::ranges::range_value_t<T>) == 1 &&
+                         std::is_trivially_copyable_v<std::ranges::range_value_t<T>>;
+
+    enum class byte_encoding { hex, b32z };
+
+    // Reference to some bytes to be encoded when (and only if) formatted.  The referenced data must
+    // outlive the log statement.
+    template <byte_encoding Encoding>
+    struct encoded_bytes {
+        const unsigned char* data;
+        size_t size;
+        size_t limit = std::numeric_limits<size_t>::max();  // Max bytes to encode; see hex_prefix
+    };
+
+    template <byte_range T>
+    const unsigned char* byte_data(const T& data) {
+        return reinterpret_cast<const unsigned char*>(std::ranges::data(data));
+    }
+
+}  // namespace detail
+
+/// Formats the given bytes (a std::string_view, span, array, vector, etc. of 1-byte values) as
+/// lower-case hex, e.g.:
+///
+///     log::debug(logcat, "Received {} from {}", log::hex(packet), log::hex(pubkey));
+///
+/// Nothing is encoded (or allocated) unless the log statement is actually emitted, so this is
+/// preferable to converting to hex before calling the log statement.
+template <detail::byte_range T>
+detail::encoded_bytes<detail::byte_encoding::hex> hex(const T& data) {
+    return {detail::byte_data(data), std::ranges::size(data)};
+}
+
+/// Like hex(), but encodes at most the first `n` bytes, followed by "…" if there were more.  Useful
+/// to identify (rather than dump) large values, such as hashes or packet contents.
+template <detail::byte_range T>
+detail::encoded_bytes<detail::byte_encoding::hex> hex_prefix(const T& data, size_t n) {
+    return {detail::byte_data(data), std::ranges::size(data), n};
+}
+
+/// Formats the given bytes as z-base-32 (as used, for instance, for Lokinet addresses), lazily as
+/// with hex().
+template <detail::byte_range T>
+detail::encoded_bytes<detail::byte_encoding::b32z> b32z(const T& data) {
+    return {detail::byte_data(data), std::ranges::size(data)};
+}
+
+}  // namespace oxen::log
+
+template <oxen::log::detail::byte_encoding Encoding>
+struct fmt::formatter<oxen::log::detail::encoded_bytes<Encoding>> {
+    constexpr auto parse(format_parse_context& ctx) { return ctx.begin(); }
+
+    template <typename FormatContext>
+    auto format(const oxen::log::detail::encoded_bytes<Encoding>& b, FormatContext& ctx) const {
+        using namespace oxen::log::detail;
+        // Encode in chunks via a small stack buffer, so that arbitrarily large values need no
+        // allocation beyond the output buffer itself.  (Chunks for b32z are a multiple of 5 bytes
+        // so that only the final chunk can have a partial group of bits).
+        constexpr size_t CHUNK = 320;
+        char buf[Encoding == byte_encoding::hex ? 2 * CHUNK : b32z_size(CHUNK)];
+        auto out = ctx.out();
+        const size_t size = std::min(b.size, b.limit);
+        for (size_t pos = 0; pos < size; pos += CHUNK) {
+            size_t n = std::min(CHUNK, size - pos);
+            size_t len;
+            if constexpr (Encoding == byte_encoding::hex) {
+                to_hex(b.data + pos, n, buf);
+                len = 2 * n;
+            } else {
+                to_b32z(b.data + pos, n, buf);
+                len = b32z_size(n);
+            }
+            out = std::copy(buf, buf + len, out);
+        }
+        if (size < b.size)
+            out = fmt::format_to(out, "…");
+        return out;
+    }
+};
+
+#endif
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fmt/core.h>
+#include <spdlog/logger.h>
+
+#include "internal.hpp"
+#include "level.hpp"
+
+namespace oxen::log {
+
+/// Information about a log statement call site, as returned by `call_sites()`.
+struct CallSite {
+    std::string file;
+    int line;
+    std::string function;
+    std::string format;  ///< The statement's format string
+    std::string category;
+    Level level;
+    bool enabled;  ///< True if the site is enabled regardless of its category's level
+};
+
+/// Starts (or stops) recording the call sites of executed log statements, for `call_sites()`.
+/// While recording, or while any call sites are enabled, every log statement does a (lock-free)
+/// call site lookup, which makes logging slightly slower; otherwise this feature costs one
+/// predictable branch per log statement.
+void record_call_sites(bool record = true);
+
+/// Returns the recorded call sites, that is, those executed while recording or while any call
+/// sites were enabled, ordered by file and line.
+std::vector<CallSite> call_sites();
+
+/// Enables (or, with `enable` false, disables again) the log statements matching `pattern`, which
+/// is "FILE" or "FILE:LINE", where FILE may contain `*` and `?` wildcards and is matched against
+/// the whole (source-root-relative) file name, or against its end at a `/`.  For example,
+/// "quic/connection.cpp:123", "src/p2p/*" or "*.hpp".  An enabled log statement is logged even if
+/// its category's level would filter it out.
+///
+/// This applies both to matching call sites already recorded and to ones first executed later; if
+/// several calls match the same site, the last one wins.  Returns the number of already recorded
+/// call sites that matched.  Calling it again with the same pattern replaces the earlier call's
+/// effect rather than adding to it.
+size_t enable_call_sites(std::string_view pattern, bool enable = true);
+
+/// Removes all call site enables made with `enable_call_sites`.
+void reset_call_sites();
+
+namespace detail {
+
+    // True if call sites are being recorded or any are enabled
+    inline std::atomic<bool> call_sites_active = false;
+
+    // Records the call site (if not already known), and returns whether it is enabled.  Checking
+    // an already recorded site takes no lock: it is a lookup in a lock-free table followed by a
+    // relaxed load of the site's enabled flag, which enable_call_sites sets.
+    bool call_site_enabled(
+            const spdlog::logger& cat_logger,
+            Level level,
+            const source_location& location,
+            fmt::string_view format);
+
+}  // namespace detail
+
+}  // namespace oxen::log
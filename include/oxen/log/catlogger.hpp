@@ -1,15 +1,70 @@
 #pragma once
 
+#include <algorithm>
 #include <atomic>
+#include <map>
 #include <optional>
 #include <string>
 #include <functional>
+#include <string_view>
 
+#include "string_literal.hpp"
 #include "internal.hpp"
 #include "level.hpp"
+#include "sampling.hpp"
 
 namespace oxen::log {
 
+/// Levels captured by a sink from categories whose own level filters them out; see
+/// `set_capture_level`.
+struct CaptureLevels {
+    /// If set, messages of at least this level are captured from every category.
+    std::optional<Level> all;
+
+    /// Levels captured from specific categories (in addition to `all`).
+    std::map<std::string, Level, std::less<>> categories;
+
+    /// Returns the lowest level captured from the given category, or Level::off if none.
+    Level level_for(std::string_view category) const {
+        Level level = all.value_or(Level::off);
+        if (auto it = categories.find(category); it != categories.end())
+            level = std::min(level, it->second);
+        return level;
+    }
+
+    /// Returns the lowest level captured from any category, or Level::off if none.
+    Level lowest() const {
+        Level level = all.value_or(Level::off);
+        for (auto& [cat, l] : categories)
+            level = std::min(level, l);
+        return level;
+    }
+};
+
+namespace detail {
+
+    // The spdlog::logger subclass used for category loggers, which carries per-category state (such
+    // as sampling settings) alongside the level held by spdlog::logger itself.
+    class category_logger final : public spdlog::logger {
+      public:
+        using spdlog::logger::logger;
+
+        sampler sampling;
+
+        // Whether `log::span` records timing spans for this category; see set_spans
+        std::atomic<bool> spans = false;
+
+        // The lowest level that some sink captures from this category even when the category's
+        // own level filters it out (see set_capture_level), or Level::off if none.
+        std::atomic<Level> capture_level = Level::off;
+
+        // Sends a message to the logger's sinks without checking the logger's level; used for log
+        // statements enabled by `enable_call_sites`.
+        void log_unfiltered(const spdlog::details::log_msg& msg) { sink_it_(msg); }
+    };
+
+}  // namespace detail
+
 /// Wrapper class for a categorized logger.  This wrapper is provided rather than using a direct
 /// logger_ptr because, in some cases, we need construction to happen during static initialization,
 /// but actually setting up the category needs to be deferred until later, i.e.  once the logging
@@ -52,9 +107,49 @@ inline CategoryLogger Cat(std::string cat) {
     return CategoryLogger(std::move(cat));
 }
 
+namespace detail {
+
+    // An entry in the table of log categories, shared by CategoryLogger and compile-time Cat<"...">
+    // categories.  Entries are created on first use of a category name and are never removed or
+    // changed, so references to them (and their loggers) remain valid for the life of the program.
+    struct category_entry {
+        const std::string name;
+        const size_t index;  // Position in the table, i.e. the order in which categories were made
+        const logger_ptr logger;
+    };
+
+    // Returns the table entry for the given category, creating it if necessary.
+    const category_entry& find_or_make_category(std::string_view name);
+
+#if OXEN_LOGGING_CPLUSPLUS >= 202002L
+    template <string_literal Name>
+    struct static_category {
+        // Registered during static initialization, so that using it never needs a lazy-init check
+        // or lookup.  (Until then this is a null pointer, which log statements treat as disabled).
+        static inline const logger_ptr logger = find_or_make_category(Name.sv()).logger;
+    };
+#endif
+
+}  // namespace detail
+
+#if OXEN_LOGGING_CPLUSPLUS >= 202002L
+/// Returns the logger of a category whose name is known at compile time, e.g.
+///
+///     log::info(log::Cat<"p2p">(), "connected to {}", peer);
+///
+/// Unlike a CategoryLogger this is a reference to a logger set up once, during static
+/// initialization, so using it involves no atomic check, mutex, name lookup or shared_ptr copy.  It
+/// is the same logger that a runtime `Cat("p2p")` of the same name refers to, so levels and other
+/// per-category settings apply to both.
+template <detail::string_literal Name>
+const logger_ptr& Cat() {
+    return detail::static_category<Name>::logger;
+}
+#endif
+
 /// Runs a function on each existing logger and then runs the `and_then` callback (if given), all
-/// while holding a mutex that blocks new categories from being created.  There is no particular
-/// order in which the individual loggers are passed to the function.
+/// while holding a mutex that blocks new categories from being created.  Loggers are passed to the
+/// function in the order in which the categories were created.
 void for_each_cat_logger(
         std::function<void(const std::string& name, spdlog::logger& logger)> f,
         std::function<void()> and_then = nullptr);
@@ -69,6 +164,11 @@ namespace detail {
     // Internal function to retrieve the current default.
     Level get_default_catlogger_level();
 
+    // Internal function that sets the combined capture levels of all sinks, from which new cat
+    // loggers get their `capture_level`; like set_default_catlogger_level it must be called with
+    // the loggers mutex held.  External callers should use `set_capture_level` instead.
+    void set_catlogger_capture_levels(CaptureLevels levels);
+
 }  // namespace detail
 
 }  // namespace oxen::log
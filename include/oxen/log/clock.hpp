@@ -0,0 +1,53 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+
+namespace oxen::log {
+
+/// Clock sources that can be used for log message timestamps; see `set_clock`.
+enum class Clock {
+    /// std::chrono::system_clock (i.e. `clock_gettime(CLOCK_REALTIME)`).  This is the default.
+    System,
+    /// The kernel's coarse realtime clock (`CLOCK_REALTIME_COARSE`), which is considerably cheaper
+    /// to read but only has a resolution of one kernel tick (typically 1-4ms).  Only available on
+    /// Linux.
+    Coarse,
+    /// The CPU timestamp counter, calibrated against and periodically re-anchored to the system
+    /// clock.  This is the cheapest option and has high resolution, but can drift from the system
+    /// clock by a small amount between re-anchorings (about once per second).  Only available on
+    /// x86-64 CPUs with an invariant TSC.
+    TSC,
+};
+
+/// Sets the clock used to timestamp log messages from oxen::log log statements.  Returns the clock
+/// that is actually in use after the call, which will be `Clock::System` if the requested clock
+/// is not available on this system.
+///
+/// Switching to `Clock::TSC` calibrates the timestamp counter, which blocks for ~10ms.
+Clock set_clock(Clock clock);
+
+/// Returns the clock currently used for log message timestamps.
+Clock get_clock();
+
+namespace detail {
+
+    using log_clock = std::chrono::system_clock;
+
+    extern std::atomic<Clock> active_clock;
+
+    log_clock::time_point coarse_now();
+    log_clock::time_point tsc_now();
+
+    // Returns the current timestamp for a new log message using the configured clock.
+    inline log_clock::time_point clock_now() {
+        switch (active_clock.load(std::memory_order_relaxed)) {
+            case Clock::Coarse: return coarse_now();
+            case Clock::TSC: return tsc_now();
+            default: return log_clock::now();
+        }
+    }
+
+}  // namespace detail
+
+}  // namespace oxen::log
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <spdlog/details/file_helper.h>
+#include <spdlog/sinks/base_sink.h>
+
+namespace oxen::log {
+
+/// File sink that writes the log as a series of independently gzip-compressed frames, plus a
+/// sidecar index file (the log filename with ".idx" appended) recording the byte range, time range
+/// and categories of each frame.  Because each frame is a complete gzip member the log file itself
+/// is still a valid gzip file (so `zcat`, `zgrep`, etc. work on it as usual), while
+/// CompressedLogReader can use the index to decompress only the frames covering a requested time
+/// range and/or categories.
+///
+/// Messages are buffered in memory until the current frame reaches `frame_size` bytes
+/// (uncompressed), or has been open for longer than `max_frame_age` (checked by a background
+/// thread, so this also applies when nothing more gets logged), or the sink is flushed; up to that
+/// much output can be lost if the process crashes.
+///
+/// Only available when oxen-logging is built with OXEN_LOGGING_COMPRESSED_FILES; `add_sink` with
+/// Type::File and a filename ending in `.gz` then uses this sink.
+class CompressedFileSink : public spdlog::sinks::base_sink<std::mutex> {
+  public:
+    /// Opens (appending to) the log file and its index.  Throws spdlog::spdlog_ex on failure.
+    explicit CompressedFileSink(
+            std::string filename,
+            size_t frame_size = 1024 * 1024,
+            std::chrono::seconds max_frame_age = std::chrono::seconds{5});
+    ~CompressedFileSink() override;
+
+  protected:
+    void sink_it_(const spdlog::details::log_msg& msg) override;
+    void flush_() override;
+
+  private:
+    const size_t frame_size_;
+    const std::chrono::seconds max_frame_age_;
+    spdlog::details::file_helper file_;
+    spdlog::details::file_helper index_;
+
+    // The current, not yet written, frame:
+    spdlog::memory_buf_t frame_;
+    size_t frame_lines_ = 0;
+    std::chrono::system_clock::time_point frame_first_, frame_last_;
+    std::chrono::steady_clock::time_point frame_started_;
+    std::set<std::string, std::less<>> frame_cats_;
+
+    // Writes out frames that reach max_frame_age without another message arriving
+    std::condition_variable age_cv_;
+    bool stop_ = false;
+    std::thread ager_;
+
+    void write_frame();
+    void write_aged_frames();
+};
+
+/// Reader for log files written by CompressedFileSink.
+class CompressedLogReader {
+  public:
+    using time_point = std::chrono::system_clock::time_point;
+
+    /// One entry of the sidecar index.
+    struct frame {
+        uint64_t offset;
+        uint64_t size;
+        time_point first, last;
+        uint64_t lines;
+        std::vector<std::string> categories;
+    };
+
+    /// Opens the given log file and loads its index.  Throws std::runtime_error on failure.
+    explicit CompressedLogReader(std::string filename);
+
+    /// The frames of the log file, in file order.
+    const std::vector<frame>& frames() const { return frames_; }
+
+    /// Calls `f` with every log line (without trailing newline) with a timestamp in [from, to] and
+    /// a category in `categories`; a nullopt/empty argument means no restriction.  Only frames
+    /// whose index entry can contain such lines are read and decompressed.  Lines within a frame
+    /// are filtered by parsing the timestamp and category from the start of the line, which
+    /// requires the log to use the default pattern; lines that cannot be parsed are not filtered
+    /// out.  Returns the number of frames decompressed.
+    size_t read(
+            const std::function<void(std::string_view line)>& f,
+            std::optional<time_point> from = std::nullopt,
+            std::optional<time_point> to = std::nullopt,
+            const std::vector<std::string>& categories = {}) const;
+
+  private:
+    std::string filename_;
+    std::vector<frame> frames_;
+};
+
+}  // namespace oxen::log
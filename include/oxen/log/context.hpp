@@ -0,0 +1,83 @@
+#pragma once
+
+#include <iterator>
+#include <string_view>
+#include <utility>
+
+#include <fmt/format.h>
+
+namespace oxen::log {
+
+namespace detail {
+
+    // Thread-local buffer holding the rendered `key=value` fields of all the scoped_context objects
+    // currently alive on this thread, separated by spaces, in the order they were created.
+    inline thread_local fmt::basic_memory_buffer<char, 256> context_buf;
+
+    // If set, this replaces the thread's own context; this is used when formatting a message on a
+    // different thread than the one that logged it (e.g. in an IsolatedSink worker).
+    inline thread_local const std::string_view* context_override = nullptr;
+
+    /// Returns the context fields that apply to a message being formatted on this thread.
+    inline std::string_view current_context() {
+        if (context_override)
+            return *context_override;
+        return {context_buf.data(), context_buf.size()};
+    }
+
+    // RAII class that sets the context override for the current thread.
+    class scoped_context_override {
+        const std::string_view* prev_;
+
+      public:
+        explicit scoped_context_override(const std::string_view& ctx) :
+                prev_{std::exchange(context_override, &ctx)} {}
+        ~scoped_context_override() { context_override = prev_; }
+
+        scoped_context_override(const scoped_context_override&) = delete;
+        scoped_context_override& operator=(const scoped_context_override&) = delete;
+    };
+
+}  // namespace detail
+
+/// RAII class that tags all log statements on the current thread with a `key=value` field for as
+/// long as the object is alive, e.g.:
+///
+///     void handle_request(const Request& req) {
+///         log::scoped_context ctx{"req", req.id};
+///         log::debug(cat, "handling request");  // ... [req=123] handling request
+///     }
+///
+/// Scopes nest, with fields of inner scopes following those of outer scopes.  Fields are formatted
+/// once, on construction, into a thread-local buffer (which only allocates if the total length of
+/// active fields exceeds 256 bytes), and are output via the `%~` pattern flag, which is included in
+/// the default patterns.  These objects must be destroyed in the reverse order of construction on
+/// the thread that created them, so are not copyable or movable, and should only be created as
+/// local variables.
+class scoped_context {
+    size_t prev_size_;
+
+  public:
+    template <typename T>
+    scoped_context(std::string_view key, const T& value) : prev_size_{detail::context_buf.size()} {
+        auto& buf = detail::context_buf;
+        if (prev_size_)
+            buf.push_back(' ');
+        buf.append(key.data(), key.data() + key.size());
+        buf.push_back('=');
+        try {
+            fmt::format_to(std::back_inserter(buf), "{}", value);
+        } catch (...) {
+            // The destructor won't run, so we have to take back the partial field ourselves
+            buf.resize(prev_size_);
+            throw;
+        }
+    }
+
+    ~scoped_context() { detail::context_buf.resize(prev_size_); }
+
+    scoped_context(const scoped_context&) = delete;
+    scoped_context& operator=(const scoped_context&) = delete;
+};
+
+}  // namespace oxen::log
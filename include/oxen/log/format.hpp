@@ -22,6 +22,28 @@
 ///
 ///     somestr += "xyz {}"_format(42);
 ///
+/// For hot paths that must not allocate there is also (C++20 only) `_format_n`, which formats into
+/// a caller-provided fixed-size buffer, truncating if the output does not fit:
+///
+///     std::array<char, 64> buf;
+///     auto res = "xyz {}"_format_n(buf, 42);
+///     // res.str is a string_view of the output in `buf`; res.truncated() is true if cut off
+///
+/// and `oxen::log::inline_string<N>`, a string with N bytes of inline storage (and no heap
+/// fallback) that can be the target of `_format_n` or `_format_to`, and can be passed directly as
+/// an argument to log statements:
+///
+///     log::inline_string<32> id;
+///     "{}:{}"_format_n(id, host, port);
+///     log::debug(cat, "connecting to {}", id);
+///
+/// In C++20 mode the format string is parsed at compile time and turned into specialized
+/// formatting code (as with fmt's FMT_COMPILE) rather than being re-parsed on every call.  A
+/// `"..."_format` literal (without the call parentheses) may also be passed as the format argument
+/// of a log statement to get the same compile-time parsing there:
+///
+///     log::info(cat, "xyz {}"_format, 42);
+///
 /// The functions live in the `oxen::log::literals` namespace; you should use them via:
 ///
 ///     #include <oxen/log/format.hpp>
@@ -31,31 +53,45 @@
 /// to make them available (the header/namespace is not included by default from oxen-logging
 /// headers).
 
+#include <algorithm>
 #include <array>
 #include <iterator>
 #include <string_view>
+#if __has_include(<span>)
+#include <span>
+#endif
 
 #include <fmt/core.h>
+#include <fmt/compile.h>
 
-#ifdef _MSVC_LANG
-#define OXEN_LOGGING_CPLUSPLUS _MSVC_LANG
-#else
-#define OXEN_LOGGING_CPLUSPLUS __cplusplus
-#endif
+#include "string_literal.hpp"
 
 namespace oxen::log {
 
+#if OXEN_LOGGING_CPLUSPLUS >= 202002L
+template <size_t N>
+class inline_string;
+#endif
+
 namespace detail {
 
 #if OXEN_LOGGING_CPLUSPLUS >= 202002L
 
-    template <size_t N>
-    struct string_literal {
-        std::array<char, N> str;
-
-        consteval string_literal(const char (&s)[N]) { std::copy(s, s + N, str.begin()); }
+#if FMT_VERSION >= 100000
+    using fmt_compiled_string_base = fmt::compiled_string;
+#else
+    using fmt_compiled_string_base = fmt::detail::compiled_string;
+#endif
 
-        consteval std::string_view sv() const { return {str.data(), N - 1}; }
+    // fmt compiled-format string type (i.e. what FMT_COMPILE("...") produces) for a string_literal
+    // format: passing this to fmt::format or fmt::format_to parses the format string at compile
+    // time and generates formatting code specialized for it and the argument types.
+    template <string_literal Format>
+    struct compiled_format : fmt_compiled_string_base {
+        using char_type = char;
+        constexpr explicit operator fmt::string_view() const {
+            return {Format.str.data(), Format.str.size() - 1};
+        }
     };
 
     // Internal implementation of _format that holds the format as a compile-time string in the type
@@ -69,7 +105,14 @@ namespace detail {
         /// as provided during type definition (via the "..."_format user-defined function).
         template <typename... T>
         constexpr auto operator()(T&&... args) && {
-            return fmt::format(Format.sv(), std::forward<T>(args)...);
+            return fmt::format(compiled_format<Format>{}, std::forward<T>(args)...);
+        }
+
+        /// Formats into the given output iterator; this is used by log statements that are given a
+        /// `"..."_format` literal as their format string.
+        template <typename OutputIt, typename... T>
+        static constexpr OutputIt format_to(OutputIt out, T&&... args) {
+            return fmt::format_to(out, compiled_format<Format>{}, std::forward<T>(args)...);
         }
     };
 
@@ -79,7 +122,47 @@ namespace detail {
 
         template <typename String, typename... T>
         constexpr auto operator()(String& s, T&&... args) && {
-            return fmt::format_to(std::back_inserter(s), Format.sv(), std::forward<T>(args)...);
+            return fmt::format_to(
+                    std::back_inserter(s), compiled_format<Format>{}, std::forward<T>(args)...);
+        }
+    };
+
+}  // namespace detail
+
+/// Return value of a "..."_format_n(...) call.
+struct format_n_result {
+    /// The formatted output that was written into the buffer; this is a view into the buffer.
+    std::string_view str;
+    /// The full size of the formatted output.  If larger than `str.size()` then the output did not
+    /// fit in the buffer and was truncated.
+    size_t size;
+
+    constexpr bool truncated() const { return size > str.size(); }
+};
+
+namespace detail {
+
+    template <string_literal Format>
+    struct fmt_n_wrapper {
+        consteval fmt_n_wrapper() = default;
+
+        /// Formats into the given buffer, writing at most `out.size()` characters; the output is
+        /// *not* null-terminated.
+        template <typename... T>
+        auto operator()(std::span<char> out, T&&... args) && {
+            auto [end, size] = fmt::format_to_n(
+                    out.data(), out.size(), compiled_format<Format>{}, std::forward<T>(args)...);
+            return format_n_result{
+                    {out.data(), static_cast<size_t>(end - out.data())}, static_cast<size_t>(size)};
+        }
+
+        /// Replaces the contents of an inline_string with the (possibly truncated) formatted value.
+        template <size_t N, typename... T>
+        auto operator()(inline_string<N>& s, T&&... args) && {
+            auto res = std::move(*this)(std::span<char>{s.buf_}, std::forward<T>(args)...);
+            s.size_ = res.str.size();
+            s.truncated_ = res.truncated();
+            return res;
         }
     };
 
@@ -122,6 +205,64 @@ namespace detail {
 
 }  // namespace detail
 
+#if OXEN_LOGGING_CPLUSPLUS >= 202002L
+
+/// Fixed-capacity string with N bytes of inline storage and no heap fallback: anything appended
+/// beyond the capacity is discarded (and `truncated()` will return true).  This is intended for
+/// building up log arguments on hot paths without allocating; it can be passed directly as a log
+/// statement or fmt argument, and used as the target of `_format_n` (which replaces the contents)
+/// or `_format_to` (which appends).
+template <size_t N>
+class inline_string {
+    std::array<char, N> buf_;
+    size_t size_ = 0;
+    bool truncated_ = false;
+
+    template <detail::string_literal Format>
+    friend struct detail::fmt_n_wrapper;
+
+  public:
+    using value_type = char;
+
+    constexpr inline_string() = default;
+    constexpr inline_string(std::string_view s) { append(s); }
+
+    /// Appends a character, unless the string is already full.
+    constexpr void push_back(char c) {
+        if (size_ < N)
+            buf_[size_++] = c;
+        else
+            truncated_ = true;
+    }
+
+    /// Appends as much of `s` as fits.
+    constexpr void append(std::string_view s) {
+        auto n = std::min(s.size(), N - size_);
+        std::copy(s.begin(), s.begin() + n, buf_.begin() + size_);
+        size_ += n;
+        if (n < s.size())
+            truncated_ = true;
+    }
+
+    constexpr void clear() {
+        size_ = 0;
+        truncated_ = false;
+    }
+
+    /// True if anything was discarded because it did not fit.
+    constexpr bool truncated() const { return truncated_; }
+
+    constexpr const char* data() const { return buf_.data(); }
+    constexpr size_t size() const { return size_; }
+    constexpr bool empty() const { return size_ == 0; }
+    static constexpr size_t capacity() { return N; }
+
+    constexpr std::string_view view() const { return {buf_.data(), size_}; }
+    constexpr operator std::string_view() const { return view(); }
+};
+
+#endif
+
 inline namespace literals {
 
 #if OXEN_LOGGING_CPLUSPLUS >= 202002L
@@ -134,6 +275,11 @@ inline namespace literals {
     inline consteval auto operator""_format_to() {
         return detail::fmt_append_wrapper<Format>{};
     }
+
+    template <detail::string_literal Format>
+    inline consteval auto operator""_format_n() {
+        return detail::fmt_n_wrapper<Format>{};
+    }
 #else
     inline detail::fmt_wrapper17 operator""_format(const char* str, size_t len) {
         return detail::fmt_wrapper17{str, len};
@@ -147,3 +293,13 @@ inline namespace literals {
 }  // namespace literals
 
 }  // namespace oxen::log
+
+#if OXEN_LOGGING_CPLUSPLUS >= 202002L
+template <size_t N>
+struct fmt::formatter<oxen::log::inline_string<N>> : fmt::formatter<std::string_view> {
+    template <typename FormatContext>
+    auto format(const oxen::log::inline_string<N>& s, FormatContext& ctx) const {
+        return fmt::formatter<std::string_view>::format(s.view(), ctx);
+    }
+};
+#endif
@@ -8,7 +8,7 @@
 #endif
 
 #include <array>
-#include <spdlog/spdlog.h>
+#include <spdlog/logger.h>
 #include "type.hpp"
 #include "level.hpp"
 
@@ -32,6 +32,11 @@ spdlog::sink_ptr make_sink(Type type, const std::string& file);
 
 bool is_ansicolor_sink(const spdlog::sink_ptr& sink);
 
+// Returns a pattern formatter for `pattern` that supports our custom flags ('%*' for elapsed time
+// and '%~' for scoped_context fields).  Anything that sets a sink's pattern should use this rather
+// than a plain spdlog::pattern_formatter.
+std::unique_ptr<spdlog::formatter> make_pattern_formatter(std::string pattern);
+
 #ifndef OXEN_LOGGING_SOURCE_ROOTS_LEN
 #define OXEN_LOGGING_SOURCE_ROOTS_LEN 0
 #endif
@@ -57,6 +62,11 @@ inline auto spdlog_sloc(const source_location& loc) {
     return spdlog::source_loc{filename.data(), static_cast<int>(loc.line()), loc.function_name()};
 }
 
+// True while a message captured for a sink (see set_capture_level) is being delivered, i.e. a
+// message that the sink gets only because it captures a level that the message's category filters
+// out.  Sinks that keep or forward messages can check this to treat such messages differently.
+inline thread_local bool delivering_captured = false;
+
 inline void make_lc(std::string& s) {
     for (char& c : s)
         if (c >= 'A' && c <= 'Z')
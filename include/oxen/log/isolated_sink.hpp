@@ -0,0 +1,80 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <thread>
+
+#include <spdlog/sinks/sink.h>
+
+namespace oxen::log {
+
+/// Options controlling how an isolated sink (see `IsolatedSink`) buffers and sheds messages.
+struct SinkIsolation {
+    /// Maximum number of messages queued for the sink before the overflow behaviour kicks in.
+    size_t queue_size = 8192;
+
+    /// If the wrapped sink spends longer than this inside a single log or flush call it is
+    /// considered stalled (see `IsolatedSink::stalled()`); a warning saying how long the stall
+    /// lasted is written to the sink once the call returns.
+    std::chrono::milliseconds stall_threshold = std::chrono::seconds{1};
+
+    /// If true then messages for this sink are dropped (and counted) when the queue is full or
+    /// while the sink is stalled.  If false then logging threads wait for space in the queue when
+    /// it fills up, which bounds memory use but lets a stalled sink eventually apply backpressure
+    /// to logging threads.
+    bool shed_load = false;
+
+    /// When the IsolatedSink is destroyed (e.g. by `clear_sinks`) it waits up to this long for the
+    /// worker to deliver whatever is still queued.  If the wrapped sink is still stuck after that
+    /// the remaining messages are discarded and the worker thread is detached, to exit whenever the
+    /// wrapped sink finally returns.
+    std::chrono::milliseconds drain_timeout = std::chrono::seconds{1};
+};
+
+/// Sink wrapper that decouples a (potentially slow) sink from the logging threads and from the
+/// other sinks attached to the master sink.  Each message is copied into a bounded queue and
+/// delivered to the wrapped sink from a dedicated worker thread, so that, for example, a syslog
+/// stall or a file on a full disk does not block log output going to the console.
+///
+/// Typically you don't construct this directly but rather pass a SinkIsolation to `add_sink`,
+/// which returns the wrapper so that you can check on it with `stalled()` and `dropped()`.
+class IsolatedSink : public spdlog::sinks::sink {
+  public:
+    IsolatedSink(spdlog::sink_ptr sink, SinkIsolation opts = {});
+    ~IsolatedSink() override;
+
+    IsolatedSink(const IsolatedSink&) = delete;
+    IsolatedSink& operator=(const IsolatedSink&) = delete;
+
+    /// Queues the message for delivery to the wrapped sink.
+    void log(const spdlog::details::log_msg& msg) override;
+
+    /// Queues a flush of the wrapped sink; this does not wait for the flush to happen.
+    void flush() override;
+
+    void set_pattern(const std::string& pattern) override;
+    void set_formatter(std::unique_ptr<spdlog::formatter> sink_formatter) override;
+
+    /// Returns the wrapped sink.
+    const spdlog::sink_ptr& wrapped() const { return sink_; }
+
+    /// Returns true if the wrapped sink is currently stuck in a call for longer than the
+    /// configured stall threshold.
+    bool stalled() const;
+
+    /// Returns the total number of messages dropped for this sink because of load shedding.
+    uint64_t dropped() const;
+
+  private:
+    struct state;
+
+    const spdlog::sink_ptr sink_;
+    const SinkIsolation opts_;
+    // Queue and worker bookkeeping; shared with the worker thread because it can outlive us if the
+    // wrapped sink is still stuck when we get destroyed.
+    const std::shared_ptr<state> state_;
+    std::thread worker_;
+};
+
+}  // namespace oxen::log
@@ -1,7 +1,12 @@
 #pragma once
 
+#include "../log.hpp"
 #include "ring_buffer_sink.hpp"
 
+#include <limits>
+#include <optional>
+#include <vector>
+
 #include <spdlog/spdlog.h>
 #include <oxenmq/pubsub.h>
 #include <oxenmq/oxenmq.h>
@@ -16,12 +21,41 @@ using namespace std::literals;
  * Construct with a RingBufferSink which is registered with oxen::logging
  * and a reference to the OxenMQ object used for RPC.
  *
+ * Each subscription can have a LogFilter, which is checked against each log message before
+ * anything is sent to that subscriber.  The RingBufferSink captures (see log::set_capture_level)
+ * messages from each category down to the lowest `min_level` of the current subscribers' filters
+ * that select that category, so that a subscriber can get messages that are below the levels of
+ * their categories without changing those levels, and without them going to any other sinks.
+ * Captured messages only go to subscribers that asked for them with a `min_level`, and are not
+ * kept in the RingBufferSink (so `send_all`/`send_since` don't include them).
+ *
  * *** The OxenMQ reference must remain valid for the lifetime of this class! ***
  */
 class PubsubLogger {
+    struct subscriber {
+        std::string endpoint;
+        LogFilter filter;
+    };
+
     oxenmq::OxenMQ& omq;
     const std::shared_ptr<RingBufferSink> buffer;
-    oxenmq::Subscription<std::string> subs;
+    oxenmq::Subscription<subscriber> subs;
+
+    // Captures, from each category, the lowest `min_level` of the subscribers wanting it
+    void update_capture_level() {
+        CaptureLevels levels;
+        subs.publish([&levels](const auto&, const subscriber& sub) {
+            auto& min = sub.filter.min_level;
+            if (!min)
+                return;
+            if (sub.filter.categories.empty())
+                levels.all = std::min(levels.all.value_or(Level::off), *min);
+            for (auto& cat : sub.filter.categories)
+                if (auto [it, ins] = levels.categories.emplace(cat, *min); !ins)
+                    it->second = std::min(it->second, *min);
+        });
+        set_capture_level(buffer, std::move(levels));
+    }
 
   public:
     PubsubLogger() = delete;
@@ -32,28 +66,63 @@ class PubsubLogger {
             omq{_omq}, buffer{std::move(_buffer)}, subs{"omq rpc logger"s, sub_duration} {
         if (!buffer)
             throw std::runtime_error{"PubsubLogger must be supplied a RingBufferSink"};
-        buffer->set_log_callback([this](const auto& message) {
-            subs.publish([this, message](const auto& conn, const auto& endpoint) {
-                omq.send(conn, endpoint, message);
-            });
-        });
+        buffer->set_log_msg_callback(
+                [this](const auto& msg, const std::string& message, bool captured) {
+                    subs.publish([&](const auto& conn, const subscriber& sub) {
+                        if ((!captured || sub.filter.min_level) && sub.filter.matches(msg))
+                            omq.send(conn, sub.endpoint, message);
+                    });
+                });
     }
 
-    ~PubsubLogger() { buffer->set_log_callback(nullptr); }
+    ~PubsubLogger() {
+        buffer->set_log_msg_callback(nullptr);
+        set_capture_level(buffer, std::nullopt);
+    }
 
-    bool subscribe(const oxenmq::ConnectionID& conn, std::string peer_rpc_endpoint) {
-        return subs.subscribe(conn, std::move(peer_rpc_endpoint));
+    /// Adds a subscription (or renews an existing one, replacing its filter).  Returns true if this
+    /// is a new subscription.
+    bool subscribe(
+            const oxenmq::ConnectionID& conn,
+            std::string peer_rpc_endpoint,
+            LogFilter filter = {}) {
+        bool added = subs.subscribe(
+                conn, subscriber{std::move(peer_rpc_endpoint), std::move(filter)});
+        update_capture_level();
+        return added;
     }
 
     bool unsubscribe(const oxenmq::ConnectionID& conn) {
-        return subs.unsubscribe(conn).has_value();
+        bool removed = subs.unsubscribe(conn).has_value();
+        update_capture_level();
+        return removed;
     }
 
-    void remove_expired() { subs.remove_expired(); }
+    void remove_expired() {
+        subs.remove_expired();
+        update_capture_level();
+    }
 
     void send_all(const oxenmq::ConnectionID& conn, const std::string& endpoint) {
         omq.send(conn, endpoint, oxenmq::send_option::data_parts(buffer->get_all()));
     }
+
+    /// Sends the buffered log lines after sequence number `seq` that match `filter` (see
+    /// RingBufferSink::get_since), and returns the sequence number to pass next time to send just
+    /// the lines logged since.
+    uint64_t send_since(
+            const oxenmq::ConnectionID& conn,
+            const std::string& endpoint,
+            uint64_t seq,
+            const LogFilter& filter = {}) {
+        auto [records, last] = buffer->get_since(seq, std::numeric_limits<size_t>::max(), filter);
+        std::vector<std::string> lines;
+        lines.reserve(records.size());
+        for (auto& r : records)
+            lines.push_back(std::move(r.line));
+        omq.send(conn, endpoint, oxenmq::send_option::data_parts(lines));
+        return last;
+    }
 };
 
 }  // namespace oxen::log
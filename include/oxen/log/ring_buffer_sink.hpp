@@ -3,28 +3,109 @@
 #include <spdlog/spdlog.h>
 #include <spdlog/sinks/base_sink.h>
 
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <limits>
 #include <list>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <functional>
+#include <vector>
+
+#include "internal.hpp"
+#include "level.hpp"
 
 namespace oxen::log {
 
+/// Selects log messages by level, category and/or content, e.g. for a PubsubLogger subscription.
+/// The default filter selects everything.
+struct LogFilter {
+    /// If set, only messages of at least this level are selected.  (Unset, the filter doesn't
+    /// select by level, leaving just the levels of the categories themselves).
+    std::optional<Level> min_level;
+
+    /// If non-empty, only messages of these categories are selected.
+    std::vector<std::string> categories;
+
+    /// If non-empty, only messages containing this string are selected.  (This is matched against
+    /// the message itself, not the parts added by the log pattern such as the timestamp, except
+    /// when querying RingBufferSink records, which only keep the formatted line).
+    std::string contains;
+
+    bool matches(Level level, std::string_view category, std::string_view message) const {
+        if (min_level && level < *min_level)
+            return false;
+        if (!categories.empty() &&
+            std::find(categories.begin(), categories.end(), category) == categories.end())
+            return false;
+        return contains.empty() || message.find(contains) != std::string_view::npos;
+    }
+
+    bool matches(const spdlog::details::log_msg& msg) const {
+        return matches(
+                msg.level,
+                {msg.logger_name.data(), msg.logger_name.size()},
+                {msg.payload.data(), msg.payload.size()});
+    }
+};
+
+/// A log message stored in a RingBufferSink.
+struct LogRecord {
+    /// Sequence number of the record: the first message stored by a RingBufferSink is 1, and each
+    /// later one is 1 more than the previous one.
+    uint64_t seq;
+    Level level;
+    std::string category;
+    std::chrono::system_clock::time_point time;
+    /// The formatted log line
+    std::string line;
+};
+
 namespace detail {
     struct MessageList {
       private:
         const size_t max_size;
-        std::list<std::string> messages;
+        std::deque<LogRecord> records;
+        uint64_t last_seq = 0;
 
       public:
         MessageList(size_t size = 100) : max_size(size) {}
 
-        void add(std::string msg) {
-            messages.push_back(std::move(msg));
-            if (messages.size() > max_size)
-                messages.pop_front();
+        void add(const spdlog::details::log_msg& msg, std::string line) {
+            records.push_back(
+                    {++last_seq,
+                     msg.level,
+                     std::string{msg.logger_name.data(), msg.logger_name.size()},
+                     msg.time,
+                     std::move(line)});
+            if (records.size() > max_size)
+                records.pop_front();
+        }
+
+        uint64_t last() const { return last_seq; }
+
+        std::list<std::string> get_all() const {
+            std::list<std::string> lines;
+            for (auto& r : records)
+                lines.push_back(r.line);
+            return lines;
         }
 
-        std::list<std::string> get_all() { return messages; }
+        // Calls `f` on each stored record with a sequence number greater than `seq`, oldest first,
+        // until it returns false.
+        template <typename F>
+        void for_each_since(uint64_t seq, F&& f) const {
+            if (records.empty())
+                return;
+            // Sequence numbers are consecutive, so we can jump straight to the first one we want
+            size_t start = seq >= records.front().seq ? seq - records.front().seq + 1 : 0;
+            for (size_t i = start; i < records.size(); i++)
+                if (!f(records[i]))
+                    break;
+        }
     };
 
 }  // namespace detail
@@ -34,22 +115,37 @@ using sink_type = spdlog::sinks::base_sink<std::mutex>;
 class RingBufferSink : public sink_type {
   public:
     using LogCallback = std::function<void(const std::string&)>;
+    /// Callback that gets the message being logged (e.g. to check its level or category against a
+    /// LogFilter) along with the formatted log line.  `captured` is true if the message's category
+    /// level filters it out and the sink only gets it because of `set_capture_level`.
+    using LogMsgCallback = std::function<void(
+            const spdlog::details::log_msg& msg, const std::string& line, bool captured)>;
 
   private:
     detail::MessageList logs;
     LogCallback onLog = nullptr;
+    LogMsgCallback onLogMsg = nullptr;
 
   public:
     RingBufferSink(size_t max_size = 100, LogCallback callback = nullptr) :
             logs{max_size}, onLog{std::move(callback)} {}
 
+    // Captured messages (see set_capture_level) only go to the LogMsgCallback: they are neither
+    // stored (so that reading the buffer gets the same messages as other sinks) nor passed to the
+    // plain LogCallback.
     void sink_it_(const spdlog::details::log_msg& msg) override {
+        bool captured = detail::delivering_captured;
+        if (captured && !onLogMsg)
+            return;
         spdlog::memory_buf_t buf;
         formatter_->format(msg, buf);
         std::string as_str = to_string(buf);
-        if (onLog)
+        if (onLog && !captured)
             onLog(as_str);
-        logs.add(std::move(as_str));
+        if (onLogMsg)
+            onLogMsg(msg, as_str, captured);
+        if (!captured)
+            logs.add(msg, std::move(as_str));
     }
 
     void set_log_callback(LogCallback callback = nullptr) {
@@ -57,11 +153,61 @@ class RingBufferSink : public sink_type {
         onLog = std::move(callback);
     }
 
+    void set_log_msg_callback(LogMsgCallback callback = nullptr) {
+        std::lock_guard lock{mutex_};
+        onLogMsg = std::move(callback);
+    }
+
     std::list<std::string> get_all() {
         std::lock_guard lock{mutex_};
         return logs.get_all();
     }
 
+    /// The result of `get_since`.
+    struct Records {
+        /// The matching records, oldest first.
+        std::vector<LogRecord> records;
+        /// The sequence number up to which records were examined; pass this to the next call to
+        /// `get_since` to get just the records after these.
+        uint64_t last_seq;
+    };
+
+    /// Returns up to `max` of the stored records with a sequence number greater than `seq` (so
+    /// `seq` 0 gets all of them) that match `filter`, for incrementally following the log:
+    ///
+    ///     uint64_t seq = 0;
+    ///     ...
+    ///     auto [records, last] = sink->get_since(seq, 1000, {.min_level = log::Level::warn});
+    ///     seq = last;
+    ///
+    /// Only matching records are copied.  If records were dropped from the buffer since `seq` then
+    /// the result starts with the oldest one still stored, which can be detected from its `seq`.
+    Records get_since(
+            uint64_t seq,
+            size_t max = std::numeric_limits<size_t>::max(),
+            const LogFilter& filter = {}) {
+        std::lock_guard lock{mutex_};
+        Records result{{}, std::max(seq, logs.last())};
+        if (max == 0)
+            return result;
+        logs.for_each_since(seq, [&](const LogRecord& r) {
+            if (!filter.matches(r.level, r.category, r.line))
+                return true;
+            result.records.push_back(r);
+            if (result.records.size() < max)
+                return true;
+            result.last_seq = r.seq;
+            return false;
+        });
+        return result;
+    }
+
+    /// Returns the sequence number of the most recently stored record (0 if there are none yet).
+    uint64_t last_seq() {
+        std::lock_guard lock{mutex_};
+        return logs.last();
+    }
+
     void flush_() override{};
 };
 
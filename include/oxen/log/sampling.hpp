@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace oxen::log {
+
+/// Sampling settings for a log category, used to get a statistical view of very high volume log
+/// statements (e.g. per-packet trace logging) at a bounded cost.  Sampling is applied to statements
+/// that pass the category's level check, before anything is formatted.  See `set_sampling`.
+struct Sampling {
+    /// If greater than 1 then only (randomly) about 1 of every `one_in` log statements is emitted.
+    uint32_t one_in = 1;
+
+    /// If non-zero then at most this many log statements per second are emitted (after applying
+    /// `one_in`), with short bursts of up to `burst` statements allowed.
+    uint32_t max_per_second = 0;
+    uint32_t burst = 1;
+};
+
+namespace detail {
+
+    // Fast thread-local PRNG (xorshift64*) used for sampling decisions.
+    inline uint64_t sampling_rand() {
+        static thread_local uint64_t state = 0;
+        if (state == 0)
+            state = reinterpret_cast<uintptr_t>(&state) * 0x9E3779B97F4A7C15ULL | 1;
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        return state * 0x2545F4914F6CDD1DULL;
+    }
+
+    // Per-category sampling state; this lives in the category logger, next to its level.
+    class sampler {
+        std::atomic<uint32_t> one_in_{1};
+        std::atomic<uint32_t> max_per_second_{0};
+        std::atomic<uint32_t> burst_{1};
+
+        // Token bucket, implemented as a GCRA: the "theoretical arrival time" of the next permitted
+        // message, plus the emission interval and burst tolerance, all in steady_clock nanoseconds.
+        std::atomic<int64_t> interval_ns_{0};
+        std::atomic<int64_t> tolerance_ns_{0};
+        std::atomic<int64_t> tat_{0};
+
+        bool rate_limit(int64_t interval);
+
+      public:
+        void set(const Sampling& s);
+        Sampling get() const;
+
+        // Returns true if a log statement should be emitted, false if it is sampled away.
+        bool sample() {
+            auto n = one_in_.load(std::memory_order_relaxed);
+            if (n > 1 && ((sampling_rand() >> 32) * n) >> 32 != 0)
+                return false;
+            auto interval = interval_ns_.load(std::memory_order_relaxed);
+            return interval == 0 || rate_limit(interval);
+        }
+    };
+
+}  // namespace detail
+
+}  // namespace oxen::log
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <spdlog/sinks/base_sink.h>
+
+#include "level.hpp"
+
+namespace oxen::log {
+
+namespace detail {
+
+    struct shm_ring_header;
+
+    // A mapping of a shared memory log ring, used by both the writing and reading sides.
+    struct shm_ring {
+        int fd = -1;
+        shm_ring_header* header = nullptr;
+        char* data = nullptr;
+        size_t map_size = 0;
+
+        shm_ring() = default;
+        shm_ring(const shm_ring&) = delete;
+        shm_ring& operator=(const shm_ring&) = delete;
+        ~shm_ring();
+    };
+
+}  // namespace detail
+
+/// Prefix of the POSIX shared memory object names (i.e. files in /dev/shm on Linux) used for log
+/// rings; the ring name given to ShmRingSink is appended to this.
+inline constexpr std::string_view SHM_RING_PREFIX = "oxen-log.";
+
+/// Sink that writes log lines into a lock-free ring buffer in POSIX shared memory, to be drained
+/// by a separate collector process (see `oxen-log-collector` in tools/) which merges the output of
+/// several processes into a single log file.
+///
+/// Writing never blocks on the collector or on disk: if the ring is full (e.g. because the
+/// collector isn't running) then messages are dropped, and counted in the ring so that the
+/// collector can report them.
+///
+/// Each ring has exactly one writing process: constructing a sink for a ring name that is already
+/// in use by another process throws.  The ring is left in place when the sink is destroyed so that
+/// the collector can finish draining it; the collector removes rings once their writer is gone and
+/// they are empty.
+class ShmRingSink : public spdlog::sinks::base_sink<std::mutex> {
+  public:
+    /// Opens or creates the ring `name` (typically the program name, such as "oxend").  `capacity`
+    /// is the ring size in bytes, and is rounded up to a power of two; it is ignored if the ring
+    /// already exists.  Throws std::runtime_error on failure.
+    explicit ShmRingSink(std::string name, size_t capacity = 4 * 1024 * 1024);
+
+    /// Returns the number of messages dropped because the ring was full.
+    uint64_t dropped() const;
+
+  protected:
+    void sink_it_(const spdlog::details::log_msg& msg) override;
+    void flush_() override {}
+
+  private:
+    detail::shm_ring ring_;
+};
+
+/// Reading side of a shared memory log ring, as used by the collector.  Each ring must only be read
+/// by one reader at a time.
+class ShmRingReader {
+  public:
+    using time_point = std::chrono::system_clock::time_point;
+
+    /// Opens an existing ring; throws std::runtime_error if it does not exist or isn't (yet) a
+    /// valid ring.
+    explicit ShmRingReader(std::string name);
+
+    /// The ring name (without SHM_RING_PREFIX).
+    const std::string& name() const { return name_; }
+
+    /// Reads up to `max` available records, calling `f` for each with the message timestamp, level,
+    /// and formatted log line (without trailing newline).  The string_view is only valid during the
+    /// call.  Returns the number of records read.
+    size_t read(
+            const std::function<void(time_point, Level, std::string_view)>& f,
+            size_t max = std::numeric_limits<size_t>::max());
+
+    /// Returns the number of messages dropped by the writer because the ring was full (plus one for
+    /// each time `read` found a corrupt record and skipped the rest of the written data), and
+    /// resets the count to zero.
+    uint64_t take_dropped();
+
+    /// Returns true if the ring has no unread records.
+    bool empty() const;
+
+    /// Returns true if no process currently has the ring open for writing.
+    bool abandoned() const;
+
+    /// Removes the ring from shared memory if it is empty and abandoned (the reader remains usable
+    /// until destroyed).  Returns true if removed.
+    bool remove_if_finished();
+
+  private:
+    std::string name_;
+    detail::shm_ring ring_;
+};
+
+/// Returns the names (without SHM_RING_PREFIX) of all existing shared memory log rings.
+std::vector<std::string> list_shm_rings();
+
+}  // namespace oxen::log
@@ -0,0 +1,496 @@
+#pragma once
+
+// Slim front-end header for log statements such as oxen::log::info(...).  This has everything
+// needed to write log statements, but not the logging setup API (sinks, levels, etc.) of
+// <oxen/log.hpp>, and avoids most of what that pulls in (spdlog.h, fmt/color.h, fmt/compile.h,
+// ...).  It is meant for code that only logs, i.e. most of a large project; include
+// <oxen/log.hpp> instead where you configure logging.  (Styled log statements and "..."_format
+// format strings still work, but the code using them has to include fmt/color.h or
+// oxen/log/format.hpp itself to create them).
+
+#include <atomic>
+#include <iterator>
+#include <memory>
+#include <string_view>
+#include <typeinfo>
+
+#include <fmt/core.h>
+#include <spdlog/logger.h>
+
+#include "call_sites.hpp"
+#include "catlogger.hpp"
+#include "internal.hpp"
+#include "level.hpp"
+#include "string_literal.hpp"
+
+FMT_BEGIN_NAMESPACE
+class text_style;
+FMT_END_NAMESPACE
+
+namespace oxen::log {
+
+namespace detail {
+
+    // Returns true if a statement at the given level should be logged: that is, if the level is
+    // enabled for the logger and the statement isn't dropped by the category's sampling settings.
+    // This is checked before any formatting happens.
+    inline bool should_log(const logger_ptr& cat_logger, Level level) {
+        if (!cat_logger || !cat_logger->should_log(level))
+            return false;
+        if (typeid(*cat_logger) != typeid(category_logger))
+            return true;
+        return static_cast<category_logger&>(*cat_logger).sampling.sample();
+    }
+
+    // The lowest level captured by any sink from any category (see set_capture_level), or
+    // Level::off if none.  This lets statements skip the per-category capture level check when
+    // nothing captures their level.
+    inline std::atomic<Level> capture_level = Level::off;
+
+    // What should_log decided about a log statement.  This is passed along with the statement so
+    // that logging the formatted message doesn't have to repeat the call site lookup.
+    struct log_decision {
+        Level level;
+        bool log = false;
+        // True if the statement's call site is enabled (see enable_call_sites), so that it gets
+        // logged even if its category's level filters it out.
+        bool call_site = false;
+
+        explicit operator bool() const { return log; }
+    };
+
+    // As above, but also logs the statement if logging has been enabled for the specific call site
+    // (see enable_call_sites), or if the level is filtered out by the category but captured by a
+    // sink (see set_capture_level).  The call site check is skipped entirely (at the cost of one
+    // well-predicted branch) unless call sites are being tracked.
+    inline log_decision should_log(
+            const logger_ptr& cat_logger,
+            Level level,
+            const source_location& location,
+            fmt::string_view format) {
+        if (call_sites_active.load(std::memory_order_relaxed)) [[unlikely]]
+            if (cat_logger && call_site_enabled(*cat_logger, level, location, format))
+                return {level, true, true};
+        if (should_log(cat_logger, level))
+            return {level, true};
+        if (level >= capture_level.load(std::memory_order_relaxed)) [[unlikely]]
+            return {level,
+                    cat_logger && !cat_logger->should_log(level) &&
+                            typeid(*cat_logger) == typeid(category_logger) &&
+                            level >= static_cast<category_logger&>(*cat_logger)
+                                             .capture_level.load(std::memory_order_relaxed)};
+        return {level};
+    }
+
+    // Logs an already-formatted message, timestamped using the configured clock (see set_clock).
+    void log_formatted(
+            const logger_ptr& cat_logger,
+            const source_location& location,
+            log_decision check,
+            std::string_view msg);
+
+    // Global maximum message size (see set_max_message_size); 0 means unlimited.
+    inline std::atomic<size_t> max_message_size = 0;
+
+    // Output iterator that appends to a buffer until it holds `limit` bytes, beyond which the
+    // output is only counted (so that the truncation marker can say exactly how much was cut).
+    class truncating_appender {
+        spdlog::memory_buf_t* buf_;
+        size_t limit_;
+        size_t* count_;
+
+      public:
+        using iterator_category = std::output_iterator_tag;
+        using value_type = void;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = void;
+
+        truncating_appender(spdlog::memory_buf_t& buf, size_t limit, size_t& count) :
+                buf_{&buf}, limit_{limit}, count_{&count} {}
+
+        truncating_appender& operator=(char c) {
+            if ((*count_)++ < limit_)
+                buf_->push_back(c);
+            return *this;
+        }
+        truncating_appender& operator*() { return *this; }
+        truncating_appender& operator++() { return *this; }
+        truncating_appender& operator++(int) { return *this; }
+    };
+
+    // Returns the length (<= max) at which to cut `s` (which must be longer than `max`) so as not
+    // to split a UTF-8 encoded character.  (This backs up over at most 3 continuation bytes, the
+    // most a valid character can have, so that we don't cut off much more than needed from
+    // non-UTF-8).
+    inline size_t truncation_point(std::string_view s, size_t max) {
+        size_t n = max;
+        while (n > 0 && max - n < 3 && (static_cast<unsigned char>(s[n]) & 0xc0) == 0x80)
+            n--;
+        return n;
+    }
+
+    // Appends the marker that replaces the `dropped` bytes cut from a truncated message.
+    inline void append_truncation_marker(spdlog::memory_buf_t& buf, size_t dropped) {
+        fmt::format_to(std::back_inserter(buf), "…[truncated {} bytes]", dropped);
+    }
+
+    // Formats a message by calling `format(out)` with an output iterator to write to, and then
+    // logs it.  The caller is responsible for checking the log level first.  If formatting throws
+    // then an error message is logged in place of the message.  If a maximum message size is set
+    // then the output is cut off at that size (with a marker saying how much was dropped): the
+    // buffer never grows beyond it, and the rest of the output is only counted.
+    template <typename Formatter>
+    void log_with(
+            const logger_ptr& cat_logger,
+            const source_location& location,
+            log_decision check,
+            Formatter&& format) {
+        spdlog::memory_buf_t buf;
+        try {
+            if (const size_t max = max_message_size.load(std::memory_order_relaxed); max == 0)
+                format(std::back_inserter(buf));
+            else {
+                // Keep one extra byte so that we can see whether the cut splits a character
+                size_t count = 0;
+                format(truncating_appender{buf, max + 1, count});
+                if (count > max) {
+                    buf.resize(truncation_point({buf.data(), buf.size()}, max));
+                    append_truncation_marker(buf, count - buf.size());
+                }
+            }
+        } catch (const std::exception& e) {
+            buf.clear();
+            fmt::format_to(std::back_inserter(buf), "[*** LOG FORMATTING ERROR: {} ***]", e.what());
+        }
+        log_formatted(cat_logger, location, check, {buf.data(), buf.size()});
+    }
+
+    // Formats and logs a message (as log_with does) from type-erased format arguments.  Log
+    // statements call this so that each one only has to pack up its arguments inline: the
+    // formatting and dispatch code is compiled once, in the library, rather than at every call
+    // site.
+    void log_vformat(
+            const logger_ptr& cat_logger,
+            const source_location& location,
+            log_decision check,
+            fmt::string_view format,
+            fmt::format_args args);
+
+    // As above, but applying a text style to the formatted message.
+    void log_vformat_styled(
+            const logger_ptr& cat_logger,
+            const source_location& location,
+            log_decision check,
+            const fmt::text_style& sty,
+            fmt::string_view format,
+            fmt::format_args args);
+
+    template <typename... T>
+    void log_fmt(
+            const logger_ptr& cat_logger,
+            const source_location& location,
+            log_decision check,
+            fmt::format_string<T...> fmt,
+            T&&... args) {
+        log_vformat(cat_logger, location, check, fmt, fmt::make_format_args(args...));
+    }
+
+    template <typename... T>
+    void log_styled(
+            const logger_ptr& cat_logger,
+            const source_location& location,
+            log_decision check,
+            const fmt::text_style& sty,
+            fmt::format_string<T...> fmt,
+            const T&... args) {
+        log_vformat_styled(cat_logger, location, check, sty, fmt, fmt::make_format_args(args...));
+    }
+
+#if OXEN_LOGGING_CPLUSPLUS >= 202002L
+    // Logs a statement whose format string is a "..."_format literal, so that the format string is
+    // parsed at compile time.
+    template <string_literal Format, typename... T>
+    void log_compiled(
+            const logger_ptr& cat_logger,
+            const source_location& location,
+            log_decision check,
+            T&&... args) {
+        log_with(cat_logger, location, check, [&](auto out) {
+            fmt_wrapper<Format>::format_to(out, std::forward<T>(args)...);
+        });
+    }
+#endif
+
+}  // namespace detail
+
+// Function-like logging statements.  These are structs for technical reasons, but are meant to be
+// used as if functions: all of the logging involved happens in the constructor.
+
+/// Log a "trace" log statement.  Use this as if a function, where the first argument is (typically)
+/// a CategoryLogger, the second argument is an fmt pattern, and the rest of the arguments are
+/// arguments for the formatted string.
+template <typename... T>
+struct trace {
+    trace(const logger_ptr& cat_logger,
+          [[maybe_unused]] fmt::format_string<T...> fmt,
+          [[maybe_unused]] T&&... args,
+          [[maybe_unused]] const source_location& location = source_location::current()) {
+#if defined(NDEBUG) && !defined(OXEN_LOGGING_RELEASE_TRACE)
+        // Using [[maybe_unused]] on the *first* ctor argument breaks gcc 8/9
+        (void)cat_logger;
+#else
+        if (auto check = detail::should_log(cat_logger, Level::trace, location, fmt))
+            detail::log_fmt(cat_logger, location, check, fmt, std::forward<T>(args)...);
+#endif
+    }
+#if OXEN_LOGGING_CPLUSPLUS >= 202002L
+    template <detail::string_literal Format>
+    trace(const logger_ptr& cat_logger,
+          detail::fmt_wrapper<Format>,
+          [[maybe_unused]] T&&... args,
+          [[maybe_unused]] const source_location& location = source_location::current()) {
+#if defined(NDEBUG) && !defined(OXEN_LOGGING_RELEASE_TRACE)
+        // Using [[maybe_unused]] on the *first* ctor argument breaks gcc 8/9
+        (void)cat_logger;
+#else
+        if (auto check = detail::should_log(cat_logger, Level::trace, location, Format.sv()))
+            detail::log_compiled<Format>(cat_logger, location, check, std::forward<T>(args)...);
+#endif
+    }
+#endif
+    trace(const logger_ptr& cat_logger,
+          [[maybe_unused]] const fmt::text_style& sty,
+          [[maybe_unused]] fmt::format_string<T...> fmt,
+          [[maybe_unused]] T&&... args,
+          [[maybe_unused]] const source_location& location = source_location::current()) {
+#if defined(NDEBUG) && !defined(OXEN_LOGGING_RELEASE_TRACE)
+        // Using [[maybe_unused]] on the *first* ctor argument breaks gcc 8/9
+        (void)cat_logger;
+#else
+        if (auto check = detail::should_log(cat_logger, Level::trace, location, fmt))
+            detail::log_styled(cat_logger, location, check, sty, fmt, args...);
+#endif
+    }
+};
+/// Log a "debug" log statement.  Use this as if a function, where the first argument is (typically)
+/// a CategoryLogger, the second argument is an fmt pattern, and the rest of the arguments are
+/// arguments for the formatted string.
+template <typename... T>
+struct debug {
+    debug(const logger_ptr& cat_logger,
+          fmt::format_string<T...> fmt,
+          T&&... args,
+          const source_location& location = source_location::current()) {
+        if (auto check = detail::should_log(cat_logger, Level::debug, location, fmt))
+            detail::log_fmt(cat_logger, location, check, fmt, std::forward<T>(args)...);
+    }
+#if OXEN_LOGGING_CPLUSPLUS >= 202002L
+    template <detail::string_literal Format>
+    debug(const logger_ptr& cat_logger,
+          detail::fmt_wrapper<Format>,
+          T&&... args,
+          const source_location& location = source_location::current()) {
+        if (auto check = detail::should_log(cat_logger, Level::debug, location, Format.sv()))
+            detail::log_compiled<Format>(cat_logger, location, check, std::forward<T>(args)...);
+    }
+#endif
+    debug(const logger_ptr& cat_logger,
+          const fmt::text_style& sty,
+          fmt::format_string<T...> fmt,
+          T&&... args,
+          const source_location& location = source_location::current()) {
+        if (auto check = detail::should_log(cat_logger, Level::debug, location, fmt))
+            detail::log_styled(cat_logger, location, check, sty, fmt, args...);
+    }
+};
+/// Log a "info" log statement.  Use this as if a function, where the first argument is (typically)
+/// a CategoryLogger, the second argument is an fmt pattern, and the rest of the arguments are
+/// arguments for the formatted string.
+template <typename... T>
+struct info {
+    info(const logger_ptr& cat_logger,
+         fmt::format_string<T...> fmt,
+         T&&... args,
+         const source_location& location = source_location::current()) {
+        if (auto check = detail::should_log(cat_logger, Level::info, location, fmt))
+            detail::log_fmt(cat_logger, location, check, fmt, std::forward<T>(args)...);
+    }
+#if OXEN_LOGGING_CPLUSPLUS >= 202002L
+    template <detail::string_literal Format>
+    info(const logger_ptr& cat_logger,
+         detail::fmt_wrapper<Format>,
+         T&&... args,
+         const source_location& location = source_location::current()) {
+        if (auto check = detail::should_log(cat_logger, Level::info, location, Format.sv()))
+            detail::log_compiled<Format>(cat_logger, location, check, std::forward<T>(args)...);
+    }
+#endif
+    info(const logger_ptr& cat_logger,
+         const fmt::text_style& sty,
+         fmt::format_string<T...> fmt,
+         T&&... args,
+         const source_location& location = source_location::current()) {
+        if (auto check = detail::should_log(cat_logger, Level::info, location, fmt))
+            detail::log_styled(cat_logger, location, check, sty, fmt, args...);
+    }
+};
+/// Log a "warning" log statement.  Use this as if a function, where the first argument is
+/// (typically) a CategoryLogger, the second argument is an fmt pattern, and the rest of the
+/// arguments are arguments for the formatted string.
+template <typename... T>
+struct warning {
+    warning(const logger_ptr& cat_logger,
+            fmt::format_string<T...> fmt,
+            T&&... args,
+            const source_location& location = source_location::current()) {
+        if (auto check = detail::should_log(cat_logger, Level::warn, location, fmt))
+            detail::log_fmt(cat_logger, location, check, fmt, std::forward<T>(args)...);
+    }
+#if OXEN_LOGGING_CPLUSPLUS >= 202002L
+    template <detail::string_literal Format>
+    warning(const logger_ptr& cat_logger,
+            detail::fmt_wrapper<Format>,
+            T&&... args,
+            const source_location& location = source_location::current()) {
+        if (auto check = detail::should_log(cat_logger, Level::warn, location, Format.sv()))
+            detail::log_compiled<Format>(cat_logger, location, check, std::forward<T>(args)...);
+    }
+#endif
+    warning(const logger_ptr& cat_logger,
+            const fmt::text_style& sty,
+            fmt::format_string<T...> fmt,
+            T&&... args,
+            const source_location& location = source_location::current()) {
+        if (auto check = detail::should_log(cat_logger, Level::warn, location, fmt))
+            detail::log_styled(cat_logger, location, check, sty, fmt, args...);
+    }
+};
+/// Log a "error" log statement.  Use this as if a function, where the first argument is (typically)
+/// a CategoryLogger, the second argument is an fmt pattern, and the rest of the arguments are
+/// arguments for the formatted string.
+template <typename... T>
+struct error {
+    error(const logger_ptr& cat_logger,
+          fmt::format_string<T...> fmt,
+          T&&... args,
+          const source_location& location = source_location::current()) {
+        if (auto check = detail::should_log(cat_logger, Level::err, location, fmt))
+            detail::log_fmt(cat_logger, location, check, fmt, std::forward<T>(args)...);
+    }
+#if OXEN_LOGGING_CPLUSPLUS >= 202002L
+    template <detail::string_literal Format>
+    error(const logger_ptr& cat_logger,
+          detail::fmt_wrapper<Format>,
+          T&&... args,
+          const source_location& location = source_location::current()) {
+        if (auto check = detail::should_log(cat_logger, Level::err, location, Format.sv()))
+            detail::log_compiled<Format>(cat_logger, location, check, std::forward<T>(args)...);
+    }
+#endif
+    error(const logger_ptr& cat_logger,
+          const fmt::text_style& sty,
+          fmt::format_string<T...> fmt,
+          T&&... args,
+          const source_location& location = source_location::current()) {
+        if (auto check = detail::should_log(cat_logger, Level::err, location, fmt))
+            detail::log_styled(cat_logger, location, check, sty, fmt, args...);
+    }
+};
+/// Log a "critical" log statement.  Use this as if a function, where the first argument is
+/// (typically) a CategoryLogger, the second argument is an fmt pattern, and the rest of the
+/// arguments are arguments for the formatted string.
+template <typename... T>
+struct critical {
+    critical(
+            const logger_ptr& cat_logger,
+            fmt::format_string<T...> fmt,
+            T&&... args,
+            const source_location& location = source_location::current()) {
+        if (auto check = detail::should_log(cat_logger, Level::critical, location, fmt))
+            detail::log_fmt(cat_logger, location, check, fmt, std::forward<T>(args)...);
+    }
+#if OXEN_LOGGING_CPLUSPLUS >= 202002L
+    template <detail::string_literal Format>
+    critical(
+            const logger_ptr& cat_logger,
+            detail::fmt_wrapper<Format>,
+            T&&... args,
+            const source_location& location = source_location::current()) {
+        if (auto check = detail::should_log(cat_logger, Level::critical, location, Format.sv()))
+            detail::log_compiled<Format>(cat_logger, location, check, std::forward<T>(args)...);
+    }
+#endif
+    critical(
+            const logger_ptr& cat_logger,
+            const fmt::text_style& sty,
+            fmt::format_string<T...> fmt,
+            T&&... args,
+            const source_location& location = source_location::current()) {
+        if (auto check = detail::should_log(cat_logger, Level::critical, location, fmt))
+            detail::log_styled(cat_logger, location, check, sty, fmt, args...);
+    }
+};
+
+// Deduction guides for our logging function-like structs; these force all arguments given in the
+// constructor to become explicit `T` constructor arguments, which in turn forces the
+// source_location constructor argument to always get defaulted, which is what we want.  (This
+// little deduction guide trick is why we need classes: automatic deduction of generic types won't
+// work with the trailing defaulted value).
+template <typename... T>
+trace(const logger_ptr& cat, fmt::format_string<T...> fmt, T&&... args) -> trace<T...>;
+template <typename... T>
+trace(const logger_ptr& cat, const fmt::text_style& sty, fmt::format_string<T...> fmt, T&&... args)
+        -> trace<T...>;
+
+template <typename... T>
+debug(const logger_ptr& cat, fmt::format_string<T...> fmt, T&&... args) -> debug<T...>;
+template <typename... T>
+debug(const logger_ptr& cat, const fmt::text_style& sty, fmt::format_string<T...> fmt, T&&... args)
+        -> debug<T...>;
+
+template <typename... T>
+info(const logger_ptr& cat, fmt::format_string<T...> fmt, T&&... args) -> info<T...>;
+template <typename... T>
+info(const logger_ptr& cat, const fmt::text_style& sty, fmt::format_string<T...> fmt, T&&... args)
+        -> info<T...>;
+
+template <typename... T>
+warning(const logger_ptr& cat, fmt::format_string<T...> fmt, T&&... args) -> warning<T...>;
+template <typename... T>
+warning(const logger_ptr& cat,
+        const fmt::text_style& sty,
+        fmt::format_string<T...> fmt,
+        T&&... args) -> warning<T...>;
+
+template <typename... T>
+error(const logger_ptr& cat, fmt::format_string<T...> fmt, T&&... args) -> error<T...>;
+template <typename... T>
+error(const logger_ptr& cat, const fmt::text_style& sty, fmt::format_string<T...> fmt, T&&... args)
+        -> error<T...>;
+
+template <typename... T>
+critical(const logger_ptr& cat, fmt::format_string<T...> fmt, T&&... args) -> critical<T...>;
+template <typename... T>
+critical(
+        const logger_ptr& cat,
+        const fmt::text_style& sty,
+        fmt::format_string<T...> fmt,
+        T&&... args) -> critical<T...>;
+
+#if OXEN_LOGGING_CPLUSPLUS >= 202002L
+template <detail::string_literal Format, typename... T>
+trace(const logger_ptr& cat, detail::fmt_wrapper<Format> fmt, T&&... args) -> trace<T...>;
+template <detail::string_literal Format, typename... T>
+debug(const logger_ptr& cat, detail::fmt_wrapper<Format> fmt, T&&... args) -> debug<T...>;
+template <detail::string_literal Format, typename... T>
+info(const logger_ptr& cat, detail::fmt_wrapper<Format> fmt, T&&... args) -> info<T...>;
+template <detail::string_literal Format, typename... T>
+warning(const logger_ptr& cat, detail::fmt_wrapper<Format> fmt, T&&... args) -> warning<T...>;
+template <detail::string_literal Format, typename... T>
+error(const logger_ptr& cat, detail::fmt_wrapper<Format> fmt, T&&... args) -> error<T...>;
+template <detail::string_literal Format, typename... T>
+critical(const logger_ptr& cat, detail::fmt_wrapper<Format> fmt, T&&... args) -> critical<T...>;
+#endif
+
+}  // namespace oxen::log
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <typeinfo>
+
+#include "catlogger.hpp"
+#include "internal.hpp"
+
+namespace oxen::log {
+
+namespace detail {
+
+    // The number of categories with spans enabled, so that a span of a disabled category costs only
+    // a single (relaxed) atomic load when no category has spans enabled at all.
+    inline std::atomic<int> spans_enabled_count = 0;
+
+    inline bool spans_enabled(const logger_ptr& cat) {
+        if (spans_enabled_count.load(std::memory_order_relaxed) == 0) [[likely]]
+            return false;
+        return cat && typeid(*cat) == typeid(category_logger) &&
+               static_cast<const category_logger&>(*cat).spans.load(std::memory_order_relaxed);
+    }
+
+    // Appends a completed span to the calling thread's span buffer.
+    void record_span(
+            const spdlog::logger& cat,
+            const char* name,
+            std::chrono::steady_clock::time_point start,
+            std::chrono::steady_clock::time_point end);
+
+}  // namespace detail
+
+/// A timed span of code, created by `log::span()`, which records its start and end times when it
+/// is destroyed (or when `end()` is called).  A Span created for a category without spans enabled
+/// records nothing.
+class Span {
+    const spdlog::logger* cat_ = nullptr;  // nullptr if not recording
+    const char* name_ = nullptr;
+    std::chrono::steady_clock::time_point start_;
+
+  public:
+    Span() = default;
+    Span(const spdlog::logger& cat, const char* name) :
+            cat_{&cat}, name_{name}, start_{std::chrono::steady_clock::now()} {}
+
+    Span(Span&& s) noexcept : cat_{s.cat_}, name_{s.name_}, start_{s.start_} { s.cat_ = nullptr; }
+    Span& operator=(Span&& s) noexcept {
+        if (this != &s) {
+            end();
+            cat_ = s.cat_;
+            name_ = s.name_;
+            start_ = s.start_;
+            s.cat_ = nullptr;
+        }
+        return *this;
+    }
+    Span(const Span&) = delete;
+    Span& operator=(const Span&) = delete;
+
+    ~Span() { end(); }
+
+    /// Returns true if this span is being recorded.
+    bool recording() const { return cat_ != nullptr; }
+
+    /// Ends the span now rather than at destruction.  Does nothing if already ended.
+    void end() {
+        if (cat_) {
+            detail::record_span(*cat_, name_, start_, std::chrono::steady_clock::now());
+            cat_ = nullptr;
+        }
+    }
+};
+
+/// Starts a timing span named `name` in the given category, ending when the returned object is
+/// destroyed:
+///
+///     void handle_request(...) {
+///         auto s = log::span(logcat, "handle_request");
+///         ...
+///     }
+///
+/// Spans are only recorded for categories with spans enabled (see `set_spans`); otherwise this is
+/// nearly free.  Recorded spans are kept in a per-thread buffer until exported with
+/// `write_chrome_trace`.  The name must be a string literal (or otherwise outlive the export),
+/// because only its address is recorded.
+template <size_t N>
+[[nodiscard]] Span span(const logger_ptr& cat, const char (&name)[N]) {
+    if (detail::spans_enabled(cat)) [[unlikely]]
+        return Span{*cat, name};
+    return Span{};
+}
+
+/// Enables or disables recording of `log::span` timing spans for a category.  Throws
+/// std::invalid_argument if given a logger that isn't a category logger.
+void set_spans(const logger_ptr& cat, bool enabled);
+/// Enables or disables timing spans of a category, by category name.
+void set_spans(std::string cat_name, bool enabled);
+
+/// Returns whether timing spans are enabled for a category.
+bool get_spans(const logger_ptr& cat);
+/// Returns whether timing spans are enabled for a category, by category name.
+bool get_spans(std::string cat_name);
+
+/// Enables or disables timing spans for all existing categories.
+void reset_spans(bool enabled);
+
+/// Sets the number of spans each thread keeps; once full, the oldest spans of the thread are
+/// overwritten.  Applies to threads that haven't recorded a span yet.  The default is 65536.
+void set_span_buffer_size(size_t spans);
+
+/// Writes all recorded spans as Chrome trace event JSON, which can be loaded into Perfetto
+/// (ui.perfetto.dev) or chrome://tracing, and then (if `clear` is true) discards them.  Each span
+/// is a complete ("X") event with the span category as its category; timestamps are microseconds
+/// of the steady clock.  Returns the number of spans written.
+size_t write_chrome_trace(std::ostream& out, bool clear = true);
+
+/// Writes a Chrome trace to the given file, as above.  Throws std::runtime_error if the file can't
+/// be written.
+size_t write_chrome_trace(const std::string& filename, bool clear = true);
+
+/// Discards all recorded spans.
+void clear_spans();
+
+}  // namespace oxen::log
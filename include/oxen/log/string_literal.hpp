@@ -0,0 +1,35 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <string_view>
+
+#ifdef _MSVC_LANG
+#define OXEN_LOGGING_CPLUSPLUS _MSVC_LANG
+#else
+#define OXEN_LOGGING_CPLUSPLUS __cplusplus
+#endif
+
+namespace oxen::log::detail {
+
+#if OXEN_LOGGING_CPLUSPLUS >= 202002L
+
+// A string literal usable as a template parameter, e.g. for "..."_format format strings and
+// compile-time Cat<"...">() categories.
+template <size_t N>
+struct string_literal {
+    std::array<char, N> str;
+
+    consteval string_literal(const char (&s)[N]) { std::copy(s, s + N, str.begin()); }
+
+    consteval std::string_view sv() const { return {str.data(), N - 1}; }
+};
+
+// The type of a "..."_format literal; defined in format.hpp.
+template <string_literal Format>
+struct fmt_wrapper;
+
+#endif
+
+}  // namespace oxen::log::detail
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <spdlog/details/file_helper.h>
+#include <spdlog/sinks/base_sink.h>
+
+namespace oxen::log {
+
+namespace detail {
+
+    struct uring;
+
+}  // namespace detail
+
+/// File sink (Linux only) that writes through io_uring, so that logging never blocks in write(2):
+/// log lines are formatted into one of several large buffers (registered with the kernel, when
+/// possible), and full buffers are submitted as asynchronous writes while logging continues into
+/// the next one.  When no write is in progress the current buffer is submitted as soon as it holds
+/// 4kiB (so at low volume lines reach the file about as soon as with a plain, stdio-buffered file
+/// sink), while at high volume writes grow up to the full buffer size.  Logging only waits for the
+/// kernel if all buffers are still being written.
+///
+/// Flushing submits any buffered output followed by an fdatasync, which runs once all earlier
+/// writes have completed, but does not wait for either.  All pending writes are completed when the
+/// sink is destroyed.
+///
+/// If io_uring is not available (e.g. on an older kernel, or where it is disabled by a seccomp
+/// policy) the sink falls back to ordinary buffered file writes.
+///
+/// `add_sink` with Type::File uses this sink for targets given as "uring:FILENAME".
+class UringFileSink : public spdlog::sinks::base_sink<std::mutex> {
+  public:
+    /// Opens (appending to) the log file, using `buffers` buffers of `buffer_size` bytes each.
+    /// Throws spdlog::spdlog_ex if the file cannot be opened.
+    explicit UringFileSink(
+            std::string filename, size_t buffer_size = 1024 * 1024, size_t buffers = 4);
+    ~UringFileSink() override;
+
+    /// Returns true if the sink is writing through io_uring, false if it fell back to ordinary
+    /// writes.
+    bool using_uring() const { return static_cast<bool>(ring_); }
+
+  protected:
+    void sink_it_(const spdlog::details::log_msg& msg) override;
+    void flush_() override;
+
+  private:
+    struct buffer {
+        std::unique_ptr<char[]> data;
+        size_t size = 0;
+        uint64_t offset = 0;  // File offset of the buffer's data, once submitted
+        bool in_flight = false;
+    };
+
+    const std::string filename_;
+    const size_t buffer_size_;
+    int fd_ = -1;
+    uint64_t offset_ = 0;  // File offset at which the next write goes
+    std::unique_ptr<detail::uring> ring_;
+    std::vector<buffer> buffers_;
+    size_t current_ = 0;  // Index of the buffer being filled
+    size_t in_flight_ = 0;  // Submitted operations (writes and fsyncs) not yet completed
+    spdlog::memory_buf_t line_;
+
+    std::optional<spdlog::details::file_helper> fallback_;
+
+    bool setup_ring(size_t buffers);
+    void submit_current(bool then_sync = false);
+    void queue_sync();
+    void reap(bool wait);
+    void write_direct(const char* data, size_t size);
+};
+
+}  // namespace oxen::log
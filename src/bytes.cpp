@@ -0,0 +1,116 @@
+#include <oxen/log/bytes.hpp>
+
+#include <cstdint>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define OXEN_LOGGING_X86_SIMD
+#endif
+
+namespace oxen::log::detail {
+
+namespace {
+
+    constexpr char hex_digits[] = "0123456789abcdef";
+    constexpr char b32z_alphabet[] = "ybndrfg8ejkmcpqxot1uwisza345h769";
+
+    void to_hex_scalar(const unsigned char* in, size_t size, char* out) {
+        for (size_t i = 0; i < size; i++) {
+            *out++ = hex_digits[in[i] >> 4];
+            *out++ = hex_digits[in[i] & 0x0f];
+        }
+    }
+
+#ifdef OXEN_LOGGING_X86_SIMD
+    // The SIMD kernels split each byte into high and low nibbles, map each nibble n to '0' + n
+    // (plus the distance from '9'+1 to 'a' if n > 9), and interleave the high and low digits.
+    // They return the number of input bytes handled, leaving any remainder for the scalar code.
+
+    __m128i hex_digits_sse2(__m128i n) {
+        auto letter = _mm_cmpgt_epi8(n, _mm_set1_epi8(9));
+        return _mm_add_epi8(
+                _mm_add_epi8(n, _mm_set1_epi8('0')),
+                _mm_and_si128(letter, _mm_set1_epi8('a' - '0' - 10)));
+    }
+
+    size_t to_hex_sse2(const unsigned char* in, size_t size, char* out) {
+        const auto mask = _mm_set1_epi8(0x0f);
+        size_t i = 0;
+        for (; i + 16 <= size; i += 16) {
+            auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+            auto hi = hex_digits_sse2(_mm_and_si128(_mm_srli_epi16(v, 4), mask));
+            auto lo = hex_digits_sse2(_mm_and_si128(v, mask));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2 * i), _mm_unpacklo_epi8(hi, lo));
+            _mm_storeu_si128(
+                    reinterpret_cast<__m128i*>(out + 2 * i + 16), _mm_unpackhi_epi8(hi, lo));
+        }
+        return i;
+    }
+
+    __attribute__((target("avx2"))) __m256i hex_digits_avx2(__m256i n) {
+        auto letter = _mm256_cmpgt_epi8(n, _mm256_set1_epi8(9));
+        return _mm256_add_epi8(
+                _mm256_add_epi8(n, _mm256_set1_epi8('0')),
+                _mm256_and_si256(letter, _mm256_set1_epi8('a' - '0' - 10)));
+    }
+
+    __attribute__((target("avx2"))) size_t to_hex_avx2(
+            const unsigned char* in, size_t size, char* out) {
+        const auto mask = _mm256_set1_epi8(0x0f);
+        size_t i = 0;
+        for (; i + 32 <= size; i += 32) {
+            auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+            auto hi = hex_digits_avx2(_mm256_and_si256(_mm256_srli_epi16(v, 4), mask));
+            auto lo = hex_digits_avx2(_mm256_and_si256(v, mask));
+            // The unpacks work within 128-bit lanes, giving us output bytes 0-7 and 16-23 in `a`,
+            // and 8-15 and 24-31 in `b`, so we need to recombine the lanes:
+            auto a = _mm256_unpacklo_epi8(hi, lo);
+            auto b = _mm256_unpackhi_epi8(hi, lo);
+            _mm256_storeu_si256(
+                    reinterpret_cast<__m256i*>(out + 2 * i), _mm256_permute2x128_si256(a, b, 0x20));
+            _mm256_storeu_si256(
+                    reinterpret_cast<__m256i*>(out + 2 * i + 32),
+                    _mm256_permute2x128_si256(a, b, 0x31));
+        }
+        return i;
+    }
+
+    const bool have_avx2 = __builtin_cpu_supports("avx2");
+#endif
+
+}  // namespace
+
+void to_hex(const unsigned char* in, size_t size, char* out) {
+    size_t done = 0;
+#ifdef OXEN_LOGGING_X86_SIMD
+    done = have_avx2 ? to_hex_avx2(in, size, out) : to_hex_sse2(in, size, out);
+#endif
+    to_hex_scalar(in + done, size - done, out + 2 * done);
+}
+
+void to_b32z(const unsigned char* in, size_t size, char* out) {
+    // Each 5 input bytes (40 bits) become 8 output characters of 5 bits each.  (Unlike hex, the 5
+    // bit groups cross byte boundaries, which doesn't map usefully onto byte shuffles, so we just
+    // do this 40 bits at a time in a 64-bit register).
+    size_t i = 0;
+    for (; i + 5 <= size; i += 5) {
+        uint64_t v = 0;
+        for (int j = 0; j < 5; j++)
+            v = v << 8 | in[i + j];
+        for (int j = 7; j >= 0; j--, v >>= 5)
+            out[j] = b32z_alphabet[v & 0x1f];
+        out += 8;
+    }
+    // A final partial group is padded with 0 bits on the right to a multiple of 5 bits
+    if (size_t rest = size - i) {
+        uint64_t v = 0;
+        for (size_t j = 0; j < rest; j++)
+            v = v << 8 | in[i + j];
+        size_t chars = b32z_size(rest);
+        v <<= chars * 5 - rest * 8;
+        for (size_t j = chars; j-- > 0; v >>= 5)
+            out[j] = b32z_alphabet[v & 0x1f];
+    }
+}
+
+}  // namespace oxen::log::detail
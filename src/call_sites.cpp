@@ -0,0 +1,241 @@
+#include <oxen/log/call_sites.hpp>
+
+#include <algorithm>
+#include <charconv>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <tuple>
+
+namespace oxen::log {
+
+namespace {
+
+    struct site {
+        std::string file;
+        int line;
+        int column;
+        std::string function;
+        std::string format;
+        std::string category;
+        Level level;
+        std::atomic<bool> enabled = false;
+    };
+
+    struct rule {
+        std::string file;
+        std::optional<int> line;
+        bool enable;
+    };
+
+    // Call sites are found by the address of their source_location's file name (plus line and
+    // column) so that the common lookup doesn't need to hash strings.  The same file can have
+    // multiple file name addresses (e.g. a header included in different translation units), so the
+    // sites themselves are kept (and deduplicated) by name.
+    struct site_loc {
+        const char* file;
+        uint32_t line;
+        uint32_t column;
+        site* st;
+    };
+
+    size_t loc_hash(const char* file, uint32_t line, uint32_t column) {
+        return std::hash<const void*>{}(file) ^ (size_t{line} << 16 | column);
+    }
+
+    // Open-addressed table of site locations that log statements look themselves up in without
+    // taking any lock.  It is only ever added to (with sites_mutex held exclusively), and is
+    // replaced by one twice the size once half full; a replaced table is kept, rather than freed,
+    // because other threads may still be probing it.  (A thread that misses a location added to
+    // the newer table just goes on to the locked path, which finds it there).
+    struct loc_table {
+        std::vector<std::atomic<const site_loc*>> slots;
+        size_t used = 0;
+
+        explicit loc_table(size_t size) : slots(size) {}
+
+        const site_loc* find(const char* file, uint32_t line, uint32_t column) const {
+            const size_t mask = slots.size() - 1;
+            for (size_t i = loc_hash(file, line, column) & mask;; i = (i + 1) & mask) {
+                auto* loc = slots[i].load(std::memory_order_acquire);
+                if (!loc || (loc->file == file && loc->line == line && loc->column == column))
+                    return loc;
+            }
+        }
+
+        void insert(const site_loc& loc) {
+            const size_t mask = slots.size() - 1;
+            size_t i = loc_hash(loc.file, loc.line, loc.column) & mask;
+            while (slots[i].load(std::memory_order_relaxed))
+                i = (i + 1) & mask;
+            slots[i].store(&loc, std::memory_order_release);
+            used++;
+        }
+    };
+
+    std::shared_mutex sites_mutex;
+    std::map<std::tuple<std::string, int, int>, std::unique_ptr<site>> sites;
+    std::deque<site_loc> site_locs;
+    std::vector<std::unique_ptr<loc_table>> loc_tables;
+    std::atomic<const loc_table*> site_lookup = nullptr;
+    std::vector<rule> rules;
+    bool recording = false;
+
+    // Must be called with the mutex held exclusively.
+    void add_site_loc(const site_loc& loc) {
+        auto& added = site_locs.emplace_back(loc);
+        auto* table = loc_tables.empty() ? nullptr : loc_tables.back().get();
+        if (table && (table->used + 1) * 2 <= table->slots.size()) {
+            table->insert(added);
+            return;
+        }
+        auto& grown = loc_tables.emplace_back(
+                std::make_unique<loc_table>(table ? table->slots.size() * 2 : 1024));
+        for (auto& l : site_locs)
+            grown->insert(l);
+        site_lookup.store(grown.get(), std::memory_order_release);
+    }
+
+    // Simple glob match supporting `*` (any sequence) and `?` (any one character).
+    bool glob_match(std::string_view pattern, std::string_view str) {
+        size_t p = 0, s = 0;
+        std::optional<size_t> star_p, star_s;
+        while (s < str.size()) {
+            if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == str[s])) {
+                p++;
+                s++;
+            } else if (p < pattern.size() && pattern[p] == '*') {
+                star_p = p++;
+                star_s = s;
+            } else if (star_p) {
+                p = *star_p + 1;
+                s = ++*star_s;
+            } else
+                return false;
+        }
+        while (p < pattern.size() && pattern[p] == '*')
+            p++;
+        return p == pattern.size();
+    }
+
+    bool matches(const rule& r, const site& st) {
+        if (r.line && *r.line != st.line)
+            return false;
+        if (glob_match(r.file, st.file))
+            return true;
+        // Otherwise try matching the end of the path, starting after any '/'
+        for (auto pos = st.file.find('/'); pos != std::string::npos;
+             pos = st.file.find('/', pos + 1))
+            if (glob_match(r.file, std::string_view{st.file}.substr(pos + 1)))
+                return true;
+        return false;
+    }
+
+    // Must be called with the mutex held exclusively.
+    void apply_rules(site& st) {
+        bool enabled = false;
+        for (auto& r : rules)
+            if (matches(r, st))
+                enabled = r.enable;
+        st.enabled = enabled;
+    }
+
+    void update_active() {
+        detail::call_sites_active = recording || !rules.empty();
+    }
+
+}  // namespace
+
+void record_call_sites(bool record) {
+    std::unique_lock lock{sites_mutex};
+    recording = record;
+    update_active();
+}
+
+std::vector<CallSite> call_sites() {
+    std::shared_lock lock{sites_mutex};
+    std::vector<CallSite> result;
+    result.reserve(sites.size());
+    for (auto& [key, st] : sites)
+        result.push_back(
+                {st->file, st->line, st->function, st->format, st->category, st->level,
+                 st->enabled});
+    return result;
+}
+
+size_t enable_call_sites(std::string_view pattern, bool enable) {
+    rule r{std::string{pattern}, std::nullopt, enable};
+    if (auto colon = pattern.rfind(':'); colon != std::string_view::npos) {
+        int line;
+        auto num = pattern.substr(colon + 1);
+        auto [end, ec] = std::from_chars(num.data(), num.data() + num.size(), line);
+        if (ec == std::errc{} && end == num.data() + num.size()) {
+            r.file = pattern.substr(0, colon);
+            r.line = line;
+        }
+    }
+
+    std::unique_lock lock{sites_mutex};
+    size_t matched = 0;
+    for (auto& [key, st] : sites)
+        if (matches(r, *st)) {
+            st->enabled = enable;
+            matched++;
+        }
+    // A rule for the same selector is replaced rather than kept, so that repeatedly toggling a
+    // site doesn't grow the list that every newly executed site gets checked against.  (The new
+    // rule goes at the end since it overrides any earlier, overlapping ones).
+    std::erase_if(rules, [&](const rule& old) { return old.file == r.file && old.line == r.line; });
+    rules.push_back(std::move(r));
+    update_active();
+    return matched;
+}
+
+void reset_call_sites() {
+    std::unique_lock lock{sites_mutex};
+    rules.clear();
+    for (auto& [key, st] : sites)
+        st->enabled = false;
+    update_active();
+}
+
+namespace detail {
+
+    bool call_site_enabled(
+            const spdlog::logger& cat_logger,
+            Level level,
+            const source_location& location,
+            fmt::string_view format) {
+        const char* file_name = location.file_name();
+        if (auto* table = site_lookup.load(std::memory_order_acquire))
+            if (auto* loc = table->find(file_name, location.line(), location.column()))
+                return loc->st->enabled.load(std::memory_order_relaxed);
+
+        std::unique_lock lock{sites_mutex};
+        if (!loc_tables.empty())
+            if (auto* loc = loc_tables.back()->find(file_name, location.line(), location.column()))
+                return loc->st->enabled.load(std::memory_order_relaxed);
+        auto sloc = spdlog_sloc(location);
+        std::string file{sloc.filename};
+        auto& st = sites[{file, sloc.line, static_cast<int>(location.column())}];
+        if (!st) {
+            st = std::make_unique<site>();
+            st->file = std::move(file);
+            st->line = sloc.line;
+            st->column = location.column();
+            st->function = location.function_name();
+            st->format.assign(format.data(), format.size());
+            st->category = cat_logger.name();
+            st->level = level;
+            apply_rules(*st);
+        }
+        add_site_loc({file_name, location.line(), location.column(), st.get()});
+        return st->enabled.load(std::memory_order_relaxed);
+    }
+
+}  // namespace detail
+
+}  // namespace oxen::log
@@ -1,28 +1,72 @@
 #include <oxen/log/catlogger.hpp>
 
+#include <deque>
+#include <unordered_map>
+
 #include <spdlog/sinks/dist_sink.h>
 
 namespace oxen::log {
 
-std::shared_ptr<spdlog::sinks::dist_sink_mt> master_sink =
-        std::make_shared<spdlog::sinks::dist_sink_mt>();
+namespace {
+
+    // The category table and master sink are function-local statics (rather than plain globals)
+    // because compile-time categories register themselves during static initialization, which can
+    // happen before this file's globals have been constructed.
+    std::shared_ptr<spdlog::sinks::dist_sink_mt>& master_sink_instance() {
+        static auto sink = std::make_shared<spdlog::sinks::dist_sink_mt>();
+        return sink;
+    }
+
+    struct category_table {
+        std::deque<detail::category_entry> entries;  // deque so that entries never move
+        std::unordered_map<std::string_view, const detail::category_entry*> by_name;
+    };
+
+    category_table& categories() {
+        static category_table table;
+        return table;
+    }
+
+    // Combined capture levels of all sinks (see set_capture_level)
+    CaptureLevels& capture_levels() {
+        static CaptureLevels levels;
+        return levels;
+    }
+
+}  // namespace
+
+std::shared_ptr<spdlog::sinks::dist_sink_mt> master_sink = master_sink_instance();
 
-static std::unordered_map<std::string, logger_ptr> loggers_;
 static std::mutex loggers_mutex_;
 static Level loggers_default_level_ = Level::info;  // Default log level for new CategoryLoggers
 
+// Must be called with loggers_mutex_ held.
+static const detail::category_entry& find_or_make_category_locked(std::string_view name) {
+    auto& table = categories();
+    if (auto it = table.by_name.find(name); it != table.by_name.end())
+        return *it->second;
+
+    auto logger =
+            std::make_shared<detail::category_logger>(std::string{name}, master_sink_instance());
+    logger->set_level(loggers_default_level_);
+    logger->capture_level = capture_levels().level_for(name);
+    auto& entry = table.entries.emplace_back(
+            detail::category_entry{std::string{name}, table.entries.size(), std::move(logger)});
+    table.by_name.emplace(entry.name, &entry);
+    return entry;
+}
+
+const detail::category_entry& detail::find_or_make_category(std::string_view name) {
+    std::lock_guard lock{loggers_mutex_};
+    return find_or_make_category_locked(name);
+}
+
 void CategoryLogger::find_or_make_logger() {
     std::lock_guard lock{loggers_mutex_};
     if (have_logger)
         return;
 
-    auto& known_logger = loggers_[name];
-    if (!known_logger) {
-        known_logger = std::make_shared<spdlog::logger>(name, master_sink);
-        known_logger->set_level(loggers_default_level_);
-    }
-
-    logger = known_logger;
+    logger = find_or_make_category_locked(name).logger;
     have_logger = true;
 }
 
@@ -31,8 +75,8 @@ void for_each_cat_logger(
         std::function<void()> and_then) {
     std::lock_guard lock{loggers_mutex_};
     if (f)
-        for (auto& [name, logger] : loggers_)
-            f(name, *logger);
+        for (auto& entry : categories().entries)
+            f(entry.name, *entry.logger);
     if (and_then)
         and_then();
 }
@@ -47,6 +91,10 @@ namespace detail {
         return loggers_default_level_;
     }
 
+    void set_catlogger_capture_levels(CaptureLevels levels) {
+        capture_levels() = std::move(levels);
+    }
+
 }  // namespace detail
 
 }  // namespace oxen::log
@@ -0,0 +1,166 @@
+#include <oxen/log/clock.hpp>
+
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+#if defined(__linux__)
+#include <time.h>
+#endif
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <cpuid.h>
+#include <x86intrin.h>
+#define OXEN_LOGGING_HAVE_TSC
+#endif
+
+namespace oxen::log {
+
+namespace detail {
+
+    std::atomic<Clock> active_clock{Clock::System};
+
+    log_clock::time_point coarse_now() {
+#ifdef CLOCK_REALTIME_COARSE
+        timespec ts;
+        clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+        return log_clock::time_point{std::chrono::duration_cast<log_clock::duration>(
+                std::chrono::seconds{ts.tv_sec} + std::chrono::nanoseconds{ts.tv_nsec})};
+#else
+        return log_clock::now();
+#endif
+    }
+
+    namespace {
+
+        int64_t system_ns() {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           log_clock::now().time_since_epoch())
+                    .count();
+        }
+
+#ifdef OXEN_LOGGING_HAVE_TSC
+        bool have_invariant_tsc() {
+            unsigned int eax, ebx, ecx, edx;
+            if (!__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) || eax < 0x80000007)
+                return false;
+            __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+            return edx & (1 << 8);
+        }
+
+        // TSC -> system clock conversion parameters, protected by a seqlock so that readers never
+        // block and never take a lock: readers retry if `seq` is odd (i.e. an update is in
+        // progress) or changed while they were reading.
+        struct tsc_calibration {
+            std::atomic<uint64_t> seq{0};
+            std::atomic<uint64_t> tsc0{0};
+            std::atomic<int64_t> ns0{0};
+            std::atomic<double> ns_per_tick{0};
+            // How many ticks before we re-anchor tsc0/ns0 to the system clock
+            std::atomic<uint64_t> reanchor_ticks{0};
+            std::atomic_flag updating = ATOMIC_FLAG_INIT;
+
+            void store(uint64_t tsc, int64_t ns, double scale) {
+                seq.fetch_add(1, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_release);
+                tsc0.store(tsc, std::memory_order_relaxed);
+                ns0.store(ns, std::memory_order_relaxed);
+                ns_per_tick.store(scale, std::memory_order_relaxed);
+                reanchor_ticks.store(
+                        static_cast<uint64_t>(1'000'000'000 / scale), std::memory_order_relaxed);
+                seq.fetch_add(1, std::memory_order_release);
+            }
+        };
+
+        tsc_calibration tsc_cal;
+
+        void calibrate_tsc() {
+            while (tsc_cal.updating.test_and_set(std::memory_order_acquire))
+                std::this_thread::yield();
+            auto ns_start = system_ns();
+            auto tsc_start = __rdtsc();
+            std::this_thread::sleep_for(std::chrono::milliseconds{10});
+            auto ns_end = system_ns();
+            auto tsc_end = __rdtsc();
+            tsc_cal.store(
+                    tsc_end,
+                    ns_end,
+                    static_cast<double>(ns_end - ns_start) /
+                            static_cast<double>(tsc_end - tsc_start));
+            tsc_cal.updating.clear(std::memory_order_release);
+        }
+#endif
+
+    }  // namespace
+
+    log_clock::time_point tsc_now() {
+#ifdef OXEN_LOGGING_HAVE_TSC
+        uint64_t seq, tsc0, reanchor, tsc;
+        int64_t ns0;
+        double scale;
+        do {
+            seq = tsc_cal.seq.load(std::memory_order_acquire);
+            tsc0 = tsc_cal.tsc0.load(std::memory_order_relaxed);
+            ns0 = tsc_cal.ns0.load(std::memory_order_relaxed);
+            scale = tsc_cal.ns_per_tick.load(std::memory_order_relaxed);
+            reanchor = tsc_cal.reanchor_ticks.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+        } while ((seq & 1) || seq != tsc_cal.seq.load(std::memory_order_relaxed));
+
+        tsc = __rdtsc();
+        auto ticks = tsc - tsc0;
+        if (ticks > reanchor && !tsc_cal.updating.test_and_set(std::memory_order_acquire)) {
+            // Re-anchor to the system clock, refining the tick rate using the (much longer)
+            // interval since the last anchor.  Only one thread does this, and everyone else just
+            // carries on with the previous anchor in the meantime.
+            auto ns = system_ns();
+            tsc = __rdtsc();
+            if (tsc > tsc0 && ns > ns0)
+                tsc_cal.store(
+                        tsc,
+                        ns,
+                        static_cast<double>(ns - ns0) / static_cast<double>(tsc - tsc0));
+            tsc_cal.updating.clear(std::memory_order_release);
+            return log_clock::time_point{
+                    std::chrono::duration_cast<log_clock::duration>(std::chrono::nanoseconds{ns})};
+        }
+        auto ns = ns0 + static_cast<int64_t>(static_cast<double>(ticks) * scale);
+        return log_clock::time_point{
+                std::chrono::duration_cast<log_clock::duration>(std::chrono::nanoseconds{ns})};
+#else
+        return log_clock::now();
+#endif
+    }
+
+}  // namespace detail
+
+Clock set_clock(Clock clock) {
+    static std::mutex clock_mutex;
+    std::lock_guard lock{clock_mutex};
+
+    switch (clock) {
+        case Clock::Coarse:
+#ifndef CLOCK_REALTIME_COARSE
+            clock = Clock::System;
+#endif
+            break;
+        case Clock::TSC:
+#ifdef OXEN_LOGGING_HAVE_TSC
+            if (detail::have_invariant_tsc())
+                detail::calibrate_tsc();
+            else
+                clock = Clock::System;
+#else
+            clock = Clock::System;
+#endif
+            break;
+        case Clock::System: break;
+    }
+    detail::active_clock.store(clock, std::memory_order_release);
+    return clock;
+}
+
+Clock get_clock() {
+    return detail::active_clock.load(std::memory_order_relaxed);
+}
+
+}  // namespace oxen::log
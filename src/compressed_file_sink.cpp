@@ -0,0 +1,340 @@
+#include <oxen/log/compressed_file_sink.hpp>
+#include <oxen/log/format.hpp>
+
+#include <algorithm>
+#include <charconv>
+#include <fstream>
+#include <stdexcept>
+
+#include <fmt/chrono.h>
+#include <zlib.h>
+
+namespace oxen::log {
+
+namespace {
+
+    int64_t to_ns(std::chrono::system_clock::time_point t) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count();
+    }
+
+    std::chrono::system_clock::time_point from_ns(int64_t ns) {
+        return std::chrono::system_clock::time_point{
+                std::chrono::duration_cast<std::chrono::system_clock::duration>(
+                        std::chrono::nanoseconds{ns})};
+    }
+
+    // Compresses `in` as a single, complete gzip member appended to `out`.
+    void gzip(std::string_view in, spdlog::memory_buf_t& out) {
+        z_stream zs{};
+        if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) !=
+            Z_OK)
+            throw std::runtime_error{"Failed to initialize zlib compression"};
+        out.resize(deflateBound(&zs, in.size()));
+        zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+        zs.avail_in = in.size();
+        zs.next_out = reinterpret_cast<Bytef*>(out.data());
+        zs.avail_out = out.size();
+        int rc = deflate(&zs, Z_FINISH);
+        out.resize(zs.total_out);
+        deflateEnd(&zs);
+        if (rc != Z_STREAM_END)
+            throw std::runtime_error{"Failed to compress log frame"};
+    }
+
+    std::string gunzip(std::string_view in) {
+        z_stream zs{};
+        if (inflateInit2(&zs, 15 + 16) != Z_OK)
+            throw std::runtime_error{"Failed to initialize zlib decompression"};
+        std::string out;
+        out.resize(in.size() * 4 + 1024);
+        zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+        zs.avail_in = in.size();
+        int rc;
+        do {
+            if (zs.total_out == out.size())
+                out.resize(out.size() * 2);
+            zs.next_out = reinterpret_cast<Bytef*>(out.data() + zs.total_out);
+            zs.avail_out = out.size() - zs.total_out;
+            rc = inflate(&zs, Z_NO_FLUSH);
+        } while (rc == Z_OK);
+        out.resize(zs.total_out);
+        inflateEnd(&zs);
+        if (rc != Z_STREAM_END)
+            throw std::runtime_error{"Failed to decompress log frame"};
+        return out;
+    }
+
+    // Formats a timestamp the way the default patterns' "[%Y-%m-%d %T]" prefix does, so that lines
+    // can be time-filtered with a simple string comparison.
+    std::string line_time(std::chrono::system_clock::time_point t) {
+        return "{:%Y-%m-%d %H:%M:%S}"_format(
+                fmt::localtime(std::chrono::system_clock::to_time_t(t)));
+    }
+
+    constexpr std::string_view INDEX_HEADER = "# oxen-log compressed log index v1\n";
+
+    // Category names in the index are percent-encoded, since ' ' and ',' delimit them (and newlines
+    // delimit entries).  Names without any of those characters are written as is.
+    bool index_escaped(char c) {
+        return c == '%' || c == ',' || c == ' ' || static_cast<unsigned char>(c) < 0x20 ||
+               c == 0x7f;
+    }
+
+    void append_index_name(std::string_view name, spdlog::memory_buf_t& out) {
+        constexpr std::string_view hex = "0123456789ABCDEF";
+        for (char c : name) {
+            if (index_escaped(c)) {
+                auto u = static_cast<unsigned char>(c);
+                char esc[3] = {'%', hex[u >> 4], hex[u & 0xf]};
+                out.append(esc, esc + 3);
+            } else
+                out.push_back(c);
+        }
+    }
+
+    int hex_value(char c) {
+        if (c >= '0' && c <= '9')
+            return c - '0';
+        if (c >= 'A' && c <= 'F')
+            return c - 'A' + 10;
+        if (c >= 'a' && c <= 'f')
+            return c - 'a' + 10;
+        return -1;
+    }
+
+    // Decodes a name written by append_index_name; an invalid escape is taken literally.
+    std::string index_name(std::string_view in) {
+        std::string name;
+        name.reserve(in.size());
+        for (size_t i = 0; i < in.size(); i++) {
+            int hi, lo;
+            if (in[i] == '%' && i + 2 < in.size() && (hi = hex_value(in[i + 1])) >= 0 &&
+                (lo = hex_value(in[i + 2])) >= 0) {
+                name.push_back(static_cast<char>(hi << 4 | lo));
+                i += 2;
+            } else
+                name.push_back(in[i]);
+        }
+        return name;
+    }
+
+}  // namespace
+
+CompressedFileSink::CompressedFileSink(
+        std::string filename, size_t frame_size, std::chrono::seconds max_frame_age) :
+        frame_size_{frame_size}, max_frame_age_{max_frame_age} {
+    file_.open(filename);
+    index_.open(filename + ".idx");
+    if (index_.size() == 0) {
+        spdlog::memory_buf_t hdr;
+        hdr.append(INDEX_HEADER.data(), INDEX_HEADER.data() + INDEX_HEADER.size());
+        index_.write(hdr);
+        index_.flush();
+    }
+    ager_ = std::thread{[this] { write_aged_frames(); }};
+}
+
+CompressedFileSink::~CompressedFileSink() {
+    {
+        std::lock_guard lock{mutex_};
+        stop_ = true;
+    }
+    age_cv_.notify_one();
+    ager_.join();
+    try {
+        std::lock_guard lock{mutex_};
+        write_frame();
+    } catch (...) {
+    }
+}
+
+void CompressedFileSink::write_aged_frames() {
+    std::unique_lock lock{mutex_};
+    while (!stop_) {
+        if (frame_lines_ == 0) {
+            age_cv_.wait(lock);
+            continue;
+        }
+        if (age_cv_.wait_until(lock, frame_started_ + max_frame_age_) == std::cv_status::timeout &&
+            frame_lines_ > 0 &&
+            std::chrono::steady_clock::now() - frame_started_ >= max_frame_age_) {
+            try {
+                write_frame();
+            } catch (...) {
+                // Nowhere to report it; the next message or flush will try again (and throw), and
+                // so will we once the frame has aged again.
+                frame_started_ = std::chrono::steady_clock::now();
+            }
+        }
+    }
+}
+
+void CompressedFileSink::sink_it_(const spdlog::details::log_msg& msg) {
+    if (frame_lines_ == 0) {
+        frame_first_ = msg.time;
+        frame_started_ = std::chrono::steady_clock::now();
+        age_cv_.notify_one();  // Starts the ager's countdown for this frame
+    }
+    frame_first_ = std::min(frame_first_, msg.time);
+    frame_last_ = std::max(frame_last_, msg.time);
+    std::string_view cat{msg.logger_name.data(), msg.logger_name.size()};
+    if (frame_cats_.find(cat) == frame_cats_.end())
+        frame_cats_.emplace(cat);
+
+    formatter_->format(msg, frame_);
+    frame_lines_++;
+
+    if (frame_.size() >= frame_size_ ||
+        std::chrono::steady_clock::now() - frame_started_ >= max_frame_age_)
+        write_frame();
+}
+
+void CompressedFileSink::flush_() {
+    write_frame();
+    file_.flush();
+}
+
+void CompressedFileSink::write_frame() {
+    if (frame_lines_ == 0)
+        return;
+
+    spdlog::memory_buf_t compressed;
+    gzip({frame_.data(), frame_.size()}, compressed);
+    auto offset = file_.size();
+    file_.write(compressed);
+    file_.flush();
+
+    // Write the index entry only once the frame itself has been written, so that the index never
+    // refers to data that isn't there.
+    spdlog::memory_buf_t entry;
+    fmt::format_to(
+            std::back_inserter(entry),
+            "{} {} {} {} {} ",
+            offset,
+            compressed.size(),
+            to_ns(frame_first_),
+            to_ns(frame_last_),
+            frame_lines_);
+    bool first = true;
+    for (auto& cat : frame_cats_) {
+        if (!first)
+            entry.push_back(',');
+        first = false;
+        append_index_name(cat, entry);
+    }
+    entry.push_back('\n');
+    index_.write(entry);
+    index_.flush();
+
+    frame_.clear();
+    frame_lines_ = 0;
+    frame_first_ = frame_last_ = {};
+    frame_cats_.clear();
+}
+
+CompressedLogReader::CompressedLogReader(std::string filename) : filename_{std::move(filename)} {
+    std::ifstream idx{filename_ + ".idx"};
+    if (!idx)
+        throw std::runtime_error{"Unable to open log index {}.idx"_format(filename_)};
+    std::ifstream data{filename_, std::ios::binary | std::ios::ate};
+    if (!data)
+        throw std::runtime_error{"Unable to open log file {}"_format(filename_)};
+    const uint64_t file_size = data.tellg();
+
+    std::string line;
+    while (std::getline(idx, line)) {
+        if (line.empty() || line[0] == '#')
+            continue;
+        // A last line without a newline is an entry cut off by a crash while it was written
+        if (idx.eof())
+            break;
+        frame f{};
+        int64_t first_ns = 0, last_ns = 0;
+        std::string_view rest{line};
+        // Parses one space-terminated number, returning false if there isn't one
+        auto parse = [&](auto& val) {
+            auto [ptr, ec] = std::from_chars(rest.data(), rest.data() + rest.size(), val);
+            if (ec != std::errc{} || ptr == rest.data() + rest.size() || *ptr != ' ')
+                return false;
+            rest.remove_prefix(ptr - rest.data() + 1);
+            return true;
+        };
+        // Skip corrupt entries, and entries beyond the end of the file (which we could get if
+        // something truncated the log file but not the index).
+        if (!parse(f.offset) || !parse(f.size) || !parse(first_ns) || !parse(last_ns) ||
+            !parse(f.lines) || f.size == 0 || f.offset > file_size ||
+            f.size > file_size - f.offset || last_ns < first_ns)
+            continue;
+        f.first = from_ns(first_ns);
+        f.last = from_ns(last_ns);
+        while (!rest.empty()) {
+            auto comma = rest.find(',');
+            f.categories.push_back(index_name(rest.substr(0, comma)));
+            rest.remove_prefix(comma == std::string_view::npos ? rest.size() : comma + 1);
+        }
+        frames_.push_back(std::move(f));
+    }
+}
+
+size_t CompressedLogReader::read(
+        const std::function<void(std::string_view line)>& f,
+        std::optional<time_point> from,
+        std::optional<time_point> to,
+        const std::vector<std::string>& categories) const {
+    std::ifstream data{filename_, std::ios::binary};
+    if (!data)
+        throw std::runtime_error{"Unable to open log file {}"_format(filename_)};
+
+    std::optional<std::string> from_str, to_str;
+    if (from)
+        from_str = line_time(*from);
+    if (to)
+        to_str = line_time(*to);
+    auto want_cat = [&](std::string_view cat) {
+        return categories.empty() ||
+               std::find(categories.begin(), categories.end(), cat) != categories.end();
+    };
+
+    size_t decompressed = 0;
+    std::string compressed;
+    for (auto& fr : frames_) {
+        if ((from && fr.last < *from) || (to && fr.first > *to))
+            continue;
+        if (!categories.empty() &&
+            std::none_of(fr.categories.begin(), fr.categories.end(), want_cat))
+            continue;
+
+        compressed.resize(fr.size);
+        data.seekg(fr.offset);
+        if (!data.read(compressed.data(), fr.size))
+            throw std::runtime_error{"Failed to read log frame at offset {}"_format(fr.offset)};
+        auto text = gunzip(compressed);
+        decompressed++;
+
+        std::string_view rest{text};
+        while (!rest.empty()) {
+            auto nl = rest.find('\n');
+            auto line = rest.substr(0, nl);
+            rest.remove_prefix(nl == std::string_view::npos ? rest.size() : nl + 1);
+
+            // Default pattern lines start with "[YYYY-MM-DD HH:MM:SS] [+elapsed] [category:level|"
+            if (line.size() > 21 && line[0] == '[' && line[20] == ']') {
+                auto ts = line.substr(1, 19);
+                if ((from_str && ts < *from_str) || (to_str && ts > *to_str))
+                    continue;
+                if (!categories.empty()) {
+                    if (auto p = line.find("] [", 21); p != std::string_view::npos) {
+                        auto cat = line.substr(p + 3);
+                        cat = cat.substr(0, cat.find(':'));
+                        if (!want_cat(cat))
+                            continue;
+                    }
+                }
+            }
+            f(line);
+        }
+    }
+    return decompressed;
+}
+
+}  // namespace oxen::log
@@ -0,0 +1,225 @@
+#include <oxen/log/isolated_sink.hpp>
+#include <oxen/log/format.hpp>
+#include <oxen/log/context.hpp>
+#include <oxen/log/internal.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+
+#include <spdlog/details/log_msg.h>
+
+namespace oxen::log {
+
+namespace {
+
+    int64_t steady_now_ns() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::steady_clock::now().time_since_epoch())
+                .count();
+    }
+
+}  // namespace
+
+struct IsolatedSink::state {
+    struct item {
+        spdlog::details::log_msg msg{};
+        // Holds the logger name and payload of `msg`, followed by the logging thread's
+        // scoped_context fields (which we have to carry over because formatting happens on the
+        // worker thread), so that a message needs at most one allocation.  `msg`'s string views
+        // only get pointed into this when delivering, because moving the item can move its
+        // contents.
+        spdlog::memory_buf_t buf{};
+        size_t context_size = 0;
+        bool flush = false;
+        // Whether this is a captured message (see set_capture_level)
+        bool captured = false;
+
+        item() = default;
+        item(const spdlog::details::log_msg& m, std::string_view context, bool captured) :
+                msg{m}, context_size{context.size()}, captured{captured} {
+            buf.append(m.logger_name.begin(), m.logger_name.end());
+            buf.append(m.payload.begin(), m.payload.end());
+            buf.append(context.data(), context.data() + context.size());
+        }
+
+        // Points `msg` at its strings in `buf`, and returns the context
+        std::string_view unpack() {
+            auto name_size = msg.logger_name.size();
+            auto payload_size = msg.payload.size();
+            msg.logger_name = {buf.data(), name_size};
+            msg.payload = {buf.data() + name_size, payload_size};
+            return {buf.data() + name_size + payload_size, context_size};
+        }
+    };
+
+    const spdlog::sink_ptr sink;
+    const SinkIsolation opts;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::condition_variable space_cv;
+    // Signalled by the worker when it exits, so that the destructor can wait for it with a timeout
+    std::condition_variable done_cv;
+    std::deque<item> queue;
+    bool stop = false;
+    // Set if the destructor gave up waiting: the worker delivers nothing more once it gets back.
+    bool abandon = false;
+    bool done = false;
+
+    // steady_clock nanoseconds-since-epoch at which the worker entered the wrapped sink, or 0 when
+    // the worker is idle.
+    std::atomic<int64_t> busy_since{0};
+    std::atomic<uint64_t> dropped{0};
+    // Drops not yet reported into the wrapped sink
+    uint64_t unreported_drops = 0;
+
+    state(spdlog::sink_ptr sink, SinkIsolation opts) : sink{std::move(sink)}, opts{opts} {}
+
+    bool stalled() const {
+        auto since = busy_since.load(std::memory_order_relaxed);
+        return since != 0 &&
+               steady_now_ns() - since >
+                       std::chrono::duration_cast<std::chrono::nanoseconds>(opts.stall_threshold)
+                               .count();
+    }
+
+    void push(item&& it) {
+        std::unique_lock lock{mutex};
+        if (opts.shed_load) {
+            if (queue.size() >= opts.queue_size || (!it.flush && stalled())) {
+                if (!it.flush) {
+                    ++dropped;
+                    ++unreported_drops;
+                }
+                return;
+            }
+        } else {
+            space_cv.wait(lock, [this] { return stop || queue.size() < opts.queue_size; });
+            if (stop)
+                return;
+        }
+        queue.push_back(std::move(it));
+        lock.unlock();
+        cv.notify_one();
+    }
+
+    // Returns how long (in ns) the wrapped sink took
+    int64_t deliver(item& it) {
+        auto started = steady_now_ns();
+        busy_since.store(started, std::memory_order_relaxed);
+        std::string_view ctx = it.flush ? std::string_view{} : it.unpack();
+        detail::scoped_context_override ctx_override{ctx};
+        detail::delivering_captured = it.captured;
+        try {
+            if (it.flush)
+                sink->flush();
+            else if (sink->should_log(it.msg.level))
+                sink->log(it.msg);
+        } catch (...) {
+            // Swallow it: there is nowhere to report a failure from the worker thread, and it must
+            // not take down the whole process.
+        }
+        detail::delivering_captured = false;
+        busy_since.store(0, std::memory_order_relaxed);
+        return steady_now_ns() - started;
+    }
+
+    void report(spdlog::level::level_enum lvl, std::string_view notice) {
+        item it{spdlog::details::log_msg{spdlog::source_loc{}, "log", lvl, notice}, {}, false};
+        deliver(it);
+    }
+
+    void run() {
+        std::unique_lock lock{mutex};
+        while (true) {
+            cv.wait(lock, [this] { return stop || !queue.empty(); });
+            if (abandon || queue.empty())
+                break;  // stop is set and we have nothing left to (or may no longer) deliver
+
+            auto it = std::move(queue.front());
+            queue.pop_front();
+            auto drops = std::exchange(unreported_drops, 0);
+            lock.unlock();
+            space_cv.notify_one();
+
+            if (drops > 0)
+                report(spdlog::level::warn,
+                       "{} log message(s) dropped while sink was stalled or overloaded"_format(
+                               drops));
+            auto took = std::chrono::nanoseconds{deliver(it)};
+            // Nothing can be reported while the sink is stuck, so we say so once it comes back.
+            if (took > opts.stall_threshold)
+                report(spdlog::level::warn,
+                       "log sink stalled for {}ms"_format(
+                               std::chrono::duration_cast<std::chrono::milliseconds>(took)
+                                       .count()));
+
+            lock.lock();
+        }
+        done = true;
+        lock.unlock();
+        done_cv.notify_all();
+    }
+};
+
+IsolatedSink::IsolatedSink(spdlog::sink_ptr sink, SinkIsolation opts) :
+        sink_{sink}, opts_{opts}, state_{std::make_shared<state>(std::move(sink), opts)} {
+    if (!sink_)
+        throw std::invalid_argument{"IsolatedSink requires a sink to wrap"};
+    if (opts_.queue_size == 0)
+        throw std::invalid_argument{"IsolatedSink queue size must be at least 1"};
+    // The worker holds its own reference to the state so that it stays valid if we detach it.
+    worker_ = std::thread{[st = state_] { st->run(); }};
+}
+
+IsolatedSink::~IsolatedSink() {
+    std::unique_lock lock{state_->mutex};
+    state_->stop = true;
+    state_->cv.notify_all();
+    state_->space_cv.notify_all();
+    if (state_->done_cv.wait_for(lock, opts_.drain_timeout, [this] { return state_->done; })) {
+        lock.unlock();
+        worker_.join();
+        return;
+    }
+    // The wrapped sink is stuck: drop whatever is left and let the worker exit on its own when (if)
+    // the sink call it is blocked in returns.
+    state_->abandon = true;
+    state_->dropped += state_->queue.size();
+    state_->queue.clear();
+    lock.unlock();
+    worker_.detach();
+}
+
+bool IsolatedSink::stalled() const {
+    return state_->stalled();
+}
+
+uint64_t IsolatedSink::dropped() const {
+    return state_->dropped;
+}
+
+void IsolatedSink::log(const spdlog::details::log_msg& msg) {
+    state_->push(state::item{msg, detail::current_context(), detail::delivering_captured});
+}
+
+void IsolatedSink::flush() {
+    state::item it;
+    it.flush = true;
+    state_->push(std::move(it));
+}
+
+void IsolatedSink::set_pattern(const std::string& pattern) {
+    set_formatter(detail::make_pattern_formatter(pattern));
+}
+
+void IsolatedSink::set_formatter(std::unique_ptr<spdlog::formatter> sink_formatter) {
+    // Formatting happens in the wrapped sink (on the worker thread), so that is where the formatter
+    // goes.
+    sink_->set_formatter(std::move(sink_formatter));
+}
+
+}  // namespace oxen::log
@@ -3,11 +3,20 @@
 #include <oxen/log/catlogger.hpp>
 #include <oxen/log/format.hpp>
 
+#include <algorithm>
 #include <chrono>
+#include <mutex>
+#include <shared_mutex>
 
 #include <spdlog/sinks/stdout_color_sinks.h>
 #include <spdlog/sinks/stdout_sinks.h>
 #include <spdlog/sinks/basic_file_sink.h>
+#ifdef OXEN_LOGGING_COMPRESSED_FILES
+#include <oxen/log/compressed_file_sink.hpp>
+#endif
+#ifdef OXEN_LOGGING_IO_URING
+#include <oxen/log/uring_file_sink.hpp>
+#endif
 #if defined(_WIN32)
 #include <spdlog/sinks/win_eventlog_sink.h>
 #elif defined(ANDROID)
@@ -22,42 +31,147 @@ namespace {
 
     using namespace std::literals;
 
-    const auto started_at = std::chrono::steady_clock::now();
+    // We compute the elapsed time from the message's own timestamp (rather than reading a second
+    // clock when formatting) so this is wall-clock time.
+    const auto started_at = std::chrono::system_clock::now();
+
+    void append_int(int64_t i, spdlog::memory_buf_t& dest) {
+        fmt::format_int f{i};
+        dest.append(f.data(), f.data() + f.size());
+    }
+
+    // Appends a non-negative number less than 10^digits, 0-padded to `digits` digits
+    void append_padded(int64_t i, int digits, spdlog::memory_buf_t& dest) {
+        char buf[3];
+        for (int d = digits - 1; d >= 0; d--, i /= 10)
+            buf[d] = static_cast<char>('0' + i % 10);
+        dest.append(buf, buf + digits);
+    }
+
+    // Appends the elapsed time since startup of a message with timestamp `time`, e.g.
+    // "+1h02m03.456s" (>= 1h), "+2m03.456s" (>= 1min), or "+3.456s".
+    void append_elapsed(std::chrono::system_clock::time_point time, spdlog::memory_buf_t& dest) {
+        using namespace std::chrono;
+        auto elapsed = std::max<system_clock::duration>(time - started_at, 0s);
+        auto h = duration_cast<hours>(elapsed).count();
+        auto m = (duration_cast<minutes>(elapsed) % 1h).count();
+        auto s = (duration_cast<seconds>(elapsed) % 1min).count();
+        auto ms = (duration_cast<milliseconds>(elapsed) % 1s).count();
+
+        dest.push_back('+');
+        if (elapsed >= 1h) {
+            append_int(h, dest);
+            dest.push_back('h');
+            append_padded(m, 2, dest);
+            dest.push_back('m');
+            append_padded(s, 2, dest);
+        } else if (elapsed >= 1min) {
+            append_int(m, dest);
+            dest.push_back('m');
+            append_padded(s, 2, dest);
+        } else
+            append_int(s, dest);
+        dest.push_back('.');
+        append_padded(ms, 3, dest);
+        dest.push_back('s');
+    }
 
     // Custom log formatting flag that prints the elapsed time since startup
     class startup_elapsed_flag : public spdlog::custom_flag_formatter {
-      private:
-#if OXEN_LOGGING_CPLUSPLUS >= 202002L
-        static constexpr fmt::format_string<
-                std::chrono::hours::rep,
-                std::chrono::minutes::rep,
-                std::chrono::seconds::rep,
-                std::chrono::milliseconds::rep>
-#else
-        static constexpr std::string_view
-#endif
-                format_hours{"+{0:d}h{1:02d}m{2:02d}.{3:03d}s"},  // >= 1h
-                format_minutes{"+{1:d}m{2:02d}.{3:03d}s"},        // >= 1min
-                format_seconds{"+{2:d}.{3:03d}s"};                // < 1min
+      public:
+        void format(
+                const spdlog::details::log_msg& msg,
+                const std::tm&,
+                spdlog::memory_buf_t& dest) override {
+            append_elapsed(msg.time, dest);
+        }
 
+        std::unique_ptr<custom_flag_formatter> clone() const override {
+            return std::make_unique<startup_elapsed_flag>();
+        }
+    };
+
+    // Custom log formatting flag that prints the current scoped_context fields, if any
+    class context_flag : public spdlog::custom_flag_formatter {
       public:
         void format(const spdlog::details::log_msg&, const std::tm&, spdlog::memory_buf_t& dest)
                 override {
-            using namespace std::literals;
-            auto elapsed = std::chrono::steady_clock::now() - started_at;
-
-            dest.append(fmt::format(
-                    elapsed >= 1h     ? format_hours
-                    : elapsed >= 1min ? format_minutes
-                                      : format_seconds,
-                    std::chrono::duration_cast<std::chrono::hours>(elapsed).count(),
-                    (std::chrono::duration_cast<std::chrono::minutes>(elapsed) % 1h).count(),
-                    (std::chrono::duration_cast<std::chrono::seconds>(elapsed) % 1min).count(),
-                    (std::chrono::duration_cast<std::chrono::milliseconds>(elapsed) % 1s).count()));
+            auto ctx = detail::current_context();
+            if (ctx.empty())
+                return;
+            dest.push_back('[');
+            dest.append(ctx.data(), ctx.data() + ctx.size());
+            dest.append("] "sv);
         }
 
         std::unique_ptr<custom_flag_formatter> clone() const override {
-            return std::make_unique<startup_elapsed_flag>();
+            return std::make_unique<context_flag>();
+        }
+    };
+
+    // Formatter for the default patterns, DEFAULT_PATTERN_COLOR and DEFAULT_PATTERN_MONO.  This
+    // produces exactly what a spdlog::pattern_formatter would for those patterns, but in one
+    // straight pass instead of calling a virtual formatter for each flag and literal of the
+    // pattern.  (If you change either default pattern, change this to match!)
+    class default_pattern_formatter final : public spdlog::formatter {
+        const bool color_;
+
+        // "[%Y-%m-%d %T] " of the last formatted message, which only changes once a second
+        std::chrono::seconds cached_secs_{-1};
+        spdlog::memory_buf_t cached_date_;
+
+      public:
+        explicit default_pattern_formatter(bool color) : color_{color} {}
+
+        void format(const spdlog::details::log_msg& msg, spdlog::memory_buf_t& dest) override {
+            auto secs = std::chrono::duration_cast<std::chrono::seconds>(
+                    msg.time.time_since_epoch());
+            if (secs != cached_secs_) {
+                auto tm = spdlog::details::os::localtime(spdlog::log_clock::to_time_t(msg.time));
+                cached_date_.clear();
+                fmt::format_to(
+                        std::back_inserter(cached_date_),
+                        "[{}-{:02d}-{:02d} {:02d}:{:02d}:{:02d}] [",
+                        tm.tm_year + 1900,
+                        tm.tm_mon + 1,
+                        tm.tm_mday,
+                        tm.tm_hour,
+                        tm.tm_min,
+                        tm.tm_sec);
+                cached_secs_ = secs;
+            }
+            dest.append(cached_date_.data(), cached_date_.data() + cached_date_.size());
+
+            append_elapsed(msg.time, dest);
+            dest.append(color_ ? "] [\x1b[1m"sv : "] ["sv);
+            dest.append(msg.logger_name.data(), msg.logger_name.data() + msg.logger_name.size());
+            dest.append(color_ ? "\x1b[0m:"sv : ":"sv);
+
+            msg.color_range_start = dest.size();
+            auto level = spdlog::level::to_string_view(msg.level);
+            dest.append(level.data(), level.data() + level.size());
+            msg.color_range_end = dest.size();
+
+            dest.append(color_ ? "|\x1b[3m"sv : "|"sv);
+            if (!msg.source.empty())
+                dest.append(std::string_view{msg.source.filename});
+            dest.push_back(':');
+            if (!msg.source.empty())
+                append_int(msg.source.line, dest);
+            dest.append(color_ ? "\x1b[0m] "sv : "] "sv);
+
+            if (auto ctx = detail::current_context(); !ctx.empty()) {
+                dest.push_back('[');
+                dest.append(ctx.data(), ctx.data() + ctx.size());
+                dest.append("] "sv);
+            }
+
+            dest.append(msg.payload.data(), msg.payload.data() + msg.payload.size());
+            dest.append(std::string_view{spdlog::details::os::default_eol});
+        }
+
+        std::unique_ptr<spdlog::formatter> clone() const override {
+            return std::make_unique<default_pattern_formatter>(color_);
         }
     };
 
@@ -77,16 +191,52 @@ namespace {
 #endif
     }
 
-    void set_sink_format(const spdlog::sink_ptr& sink, std::optional<std::string> pattern) {
-        auto formatter = std::make_unique<spdlog::pattern_formatter>();
-        formatter->add_flag<startup_elapsed_flag>('*');
+    // Formatter wrapper for sinks with their own maximum message size, which truncates the message
+    // before passing it on to the actual formatter.
+    class truncating_formatter final : public spdlog::formatter {
+        std::unique_ptr<spdlog::formatter> formatter_;
+        const size_t max_;
+
+      public:
+        truncating_formatter(std::unique_ptr<spdlog::formatter> formatter, size_t max) :
+                formatter_{std::move(formatter)}, max_{max} {}
+
+        void format(const spdlog::details::log_msg& msg, spdlog::memory_buf_t& dest) override {
+            if (msg.payload.size() <= max_)
+                return formatter_->format(msg, dest);
+            std::string_view payload{msg.payload.data(), msg.payload.size()};
+            spdlog::memory_buf_t truncated;
+            auto keep = detail::truncation_point(payload, max_);
+            truncated.append(payload.data(), payload.data() + keep);
+            detail::append_truncation_marker(truncated, payload.size() - keep);
+            auto copy = msg;
+            copy.payload = {truncated.data(), truncated.size()};
+            formatter_->format(copy, dest);
+            // The pattern formatter records where the level color goes in the message it formats,
+            // but color sinks read that from the original message.
+            msg.color_range_start = copy.color_range_start;
+            msg.color_range_end = copy.color_range_end;
+        }
+
+        std::unique_ptr<spdlog::formatter> clone() const override {
+            return std::make_unique<truncating_formatter>(formatter_->clone(), max_);
+        }
+    };
+
+    void set_sink_format(
+            const spdlog::sink_ptr& sink,
+            std::optional<std::string> pattern,
+            size_t max_message_size = 0) {
+        std::unique_ptr<spdlog::formatter> formatter;
         if (pattern)
-            formatter->set_pattern(*std::move(pattern));
-        else if (is_ansicolor_sink(sink))
-            formatter->set_pattern(DEFAULT_PATTERN_COLOR);
+            formatter = detail::make_pattern_formatter(*std::move(pattern));
+        else
+            formatter = std::make_unique<default_pattern_formatter>(is_ansicolor_sink(sink));
+        if (max_message_size > 0)
+            sink->set_formatter(
+                    std::make_unique<truncating_formatter>(std::move(formatter), max_message_size));
         else
-            formatter->set_pattern(DEFAULT_PATTERN_MONO);
-        sink->set_formatter(std::move(formatter));
+            sink->set_formatter(std::move(formatter));
     }
 
     spdlog::sink_ptr make_sink(Type type, std::string_view target) {
@@ -112,7 +262,20 @@ namespace {
 
             case Type::File:
                 // throws on error
-                sink = std::make_shared<spdlog::sinks::basic_file_sink_mt>(std::string{target});
+                if (target.substr(0, 6) == "uring:") {
+                    target.remove_prefix(6);
+#ifdef OXEN_LOGGING_IO_URING
+                    sink = std::make_shared<UringFileSink>(std::string{target});
+                    break;
+#endif
+                }
+#ifdef OXEN_LOGGING_COMPRESSED_FILES
+                if (target.size() > 3 && target.substr(target.size() - 3) == ".gz")
+                    sink = std::make_shared<CompressedFileSink>(std::string{target});
+                else
+#endif
+                    sink = std::make_shared<spdlog::sinks::basic_file_sink_mt>(
+                            std::string{target});
                 break;
 
             case Type::System:
@@ -131,6 +294,166 @@ namespace {
 
 }  // namespace
 
+namespace {
+    // Serializes changes to master_sink's sink list (which dist_sink doesn't let us read under its
+    // own lock).
+    std::mutex sinks_mutex;
+
+    // Sinks with a capture level (see set_capture_level)
+    std::shared_mutex capture_mutex;
+    struct capture_sink {
+        spdlog::sink_ptr sink;
+        // Where captured messages get delivered: the IsolatedSink wrapping `sink` if it was added
+        // with isolation, otherwise `sink` itself.
+        spdlog::sink_ptr target;
+        CaptureLevels levels;
+    };
+    std::vector<capture_sink> capture_sinks;
+
+    // Returns the sink through which master_sink delivers to `sink`: either its isolation wrapper
+    // or `sink` itself.
+    spdlog::sink_ptr delivery_target(const spdlog::sink_ptr& sink) {
+        std::lock_guard lock{sinks_mutex};
+        for (auto& s : master_sink->sinks())
+            if (auto* iso = dynamic_cast<IsolatedSink*>(s.get()); iso && iso->wrapped() == sink)
+                return s;
+        return sink;
+    }
+
+    // Must be called with capture_mutex held exclusively
+    void update_capture_level() {
+        CaptureLevels combined;
+        for (auto& [sink, target, levels] : capture_sinks) {
+            if (levels.all)
+                combined.all = std::min(combined.all.value_or(Level::off), *levels.all);
+            for (auto& [cat, level] : levels.categories)
+                if (auto [it, ins] = combined.categories.emplace(cat, level); !ins)
+                    it->second = std::min(it->second, level);
+        }
+        // Lower the global threshold first, and raise it last, so that it never excludes a level
+        // that some category still captures.
+        auto lowest = combined.lowest();
+        if (lowest < detail::capture_level)
+            detail::capture_level = lowest;
+        for_each_cat_logger(
+                [&](const std::string& name, spdlog::logger& logger) {
+                    if (typeid(logger) == typeid(detail::category_logger))
+                        static_cast<detail::category_logger&>(logger).capture_level =
+                                combined.level_for(name);
+                },
+                [&] { detail::set_catlogger_capture_levels(std::move(combined)); });
+        detail::capture_level = lowest;
+    }
+
+    // Logs a message that its category's level filters out, but that should be logged anyway
+    // because its call site is enabled (to all sinks), or because some sinks capture its level (to
+    // just those sinks).
+    void log_bypassing_level(
+            const logger_ptr& cat_logger,
+            const source_location& location,
+            detail::log_decision check,
+            std::string_view msg) {
+        const auto level = check.level;
+        spdlog::details::log_msg lmsg{
+                detail::clock_now(),
+                detail::spdlog_sloc(location),
+                cat_logger->name(),
+                level,
+                spdlog::string_view_t{msg.data(), msg.size()}};
+
+        if (check.call_site) {
+            if (typeid(*cat_logger) == typeid(detail::category_logger))
+                static_cast<detail::category_logger&>(*cat_logger).log_unfiltered(lmsg);
+            return;
+        }
+
+        std::string_view category{cat_logger->name()};
+        std::shared_lock lock{capture_mutex};
+        for (auto& [sink, target, capture] : capture_sinks) {
+            if (level < capture.level_for(category) || !sink->should_log(level))
+                continue;
+            detail::delivering_captured = true;
+            try {
+                target->log(lmsg);
+            } catch (const std::exception& e) {
+                // There's no logger error handler here, since we're bypassing the logger
+                fmt::print(
+                        stderr, "[*** LOG ERROR: captured log message failed: {} ***]\n", e.what());
+            }
+            detail::delivering_captured = false;
+        }
+    }
+}  // namespace
+
+namespace detail {
+
+    std::unique_ptr<spdlog::formatter> make_pattern_formatter(std::string pattern) {
+        auto pf = std::make_unique<spdlog::pattern_formatter>();
+        pf->add_flag<startup_elapsed_flag>('*');
+        pf->add_flag<context_flag>('~');
+        pf->set_pattern(std::move(pattern));
+        return pf;
+    }
+
+    void log_formatted(
+            const logger_ptr& cat_logger,
+            const source_location& location,
+            log_decision check,
+            std::string_view msg) {
+        if (cat_logger->should_log(check.level)) [[likely]]
+            cat_logger->log(
+                    clock_now(),
+                    spdlog_sloc(location),
+                    check.level,
+                    spdlog::string_view_t{msg.data(), msg.size()});
+        else
+            log_bypassing_level(cat_logger, location, check, msg);
+    }
+
+    void log_vformat(
+            const logger_ptr& cat_logger,
+            const source_location& location,
+            log_decision check,
+            fmt::string_view format,
+            fmt::format_args args) {
+        log_with(cat_logger, location, check, [&](auto out) {
+            fmt::vformat_to(out, format, args);
+        });
+    }
+
+    void log_vformat_styled(
+            const logger_ptr& cat_logger,
+            const source_location& location,
+            log_decision check,
+            const fmt::text_style& sty,
+            fmt::string_view format,
+            fmt::format_args args) {
+        log_with(cat_logger, location, check, [&](auto out) {
+            fmt::vformat_to(out, sty, format, args);
+        });
+    }
+
+}  // namespace detail
+
+void set_capture_level(const spdlog::sink_ptr& sink, CaptureLevels levels) {
+    std::unique_lock lock{capture_mutex};
+    auto it = std::find_if(capture_sinks.begin(), capture_sinks.end(), [&](const auto& c) {
+        return c.sink == sink;
+    });
+    if (!levels.all && levels.categories.empty()) {
+        if (it != capture_sinks.end())
+            capture_sinks.erase(it);
+    } else if (it != capture_sinks.end())
+        it->levels = std::move(levels);
+    else
+        capture_sinks.push_back({sink, delivery_target(sink), std::move(levels)});
+    update_capture_level();
+}
+
+void set_capture_level(const spdlog::sink_ptr& sink, std::optional<Level> level) {
+    set_capture_level(sink, CaptureLevels{level, {}});
+}
+
 void reset_level(Level level) {
     for_each_cat_logger(
             [level](const std::string&, spdlog::logger& logger) { logger.set_level(level); },
@@ -155,21 +478,90 @@ Level get_level(std::string cat_name) {
     return Cat(std::move(cat_name))->level();
 }
 
+namespace {
+    detail::sampler& get_sampler(const logger_ptr& cat) {
+        auto* cl = dynamic_cast<detail::category_logger*>(cat.get());
+        if (!cl)
+            throw std::invalid_argument{"Sampling is only supported on category loggers"};
+        return cl->sampling;
+    }
+}  // namespace
+
+void set_sampling(const logger_ptr& cat, Sampling sampling) {
+    get_sampler(cat).set(sampling);
+}
+
+void set_sampling(std::string cat_name, Sampling sampling) {
+    set_sampling(Cat(std::move(cat_name)), sampling);
+}
+
+Sampling get_sampling(const logger_ptr& cat) {
+    return get_sampler(cat).get();
+}
+
+Sampling get_sampling(std::string cat_name) {
+    return get_sampling(Cat(std::move(cat_name)));
+}
+
 void flush() {
     master_sink->flush();
 }
 
-void add_sink(spdlog::sink_ptr sink, std::optional<std::string> pattern) {
-    set_sink_format(sink, std::move(pattern));
-    master_sink->add_sink(std::move(sink));
+void set_max_message_size(size_t max) {
+    detail::max_message_size = max;
+}
+
+size_t get_max_message_size() {
+    return detail::max_message_size;
+}
+
+std::shared_ptr<IsolatedSink> add_sink(
+        spdlog::sink_ptr sink,
+        std::optional<std::string> pattern,
+        std::optional<SinkIsolation> isolate,
+        size_t max_message_size) {
+    set_sink_format(sink, std::move(pattern), max_message_size);
+    std::shared_ptr<IsolatedSink> isolated;
+    if (isolate)
+        isolated = std::make_shared<IsolatedSink>(sink, *isolate);
+    {
+        std::lock_guard lock{sinks_mutex};
+        master_sink->add_sink(isolated ? isolated : sink);
+    }
+    if (isolated) {
+        // If the sink already captures messages, they now have to go through the wrapper as well
+        std::unique_lock lock{capture_mutex};
+        for (auto& c : capture_sinks)
+            if (c.sink == sink)
+                c.target = isolated;
+    }
+    return isolated;
 }
 
-void add_sink(Type type, std::string_view target, std::optional<std::string> pattern) {
-    add_sink(make_sink(type, target), std::move(pattern));
+std::shared_ptr<IsolatedSink> add_sink(
+        Type type,
+        std::string_view target,
+        std::optional<std::string> pattern,
+        std::optional<SinkIsolation> isolate,
+        size_t max_message_size) {
+    return add_sink(
+            make_sink(type, target), std::move(pattern), std::move(isolate), max_message_size);
 }
 
 void clear_sinks() {
-    master_sink->set_sinks({});
+    // The removed sinks are kept alive until after the locks are released (at the end of this
+    // function) because destroying one can block for a while (e.g. an IsolatedSink waiting for its
+    // queue to drain), and logging threads must not be held up behind that.
+    std::vector<spdlog::sink_ptr> removed;
+    decltype(capture_sinks) removed_capture;
+    {
+        std::lock_guard lock{sinks_mutex};
+        removed = master_sink->sinks();
+        master_sink->set_sinks({});
+    }
+    std::unique_lock lock{capture_mutex};
+    removed_capture.swap(capture_sinks);
+    update_capture_level();
 }
 
 }  // namespace oxen::log
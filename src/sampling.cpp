@@ -0,0 +1,41 @@
+#include <oxen/log/sampling.hpp>
+
+#include <algorithm>
+#include <chrono>
+
+namespace oxen::log::detail {
+
+void sampler::set(const Sampling& s) {
+    one_in_ = std::max<uint32_t>(s.one_in, 1);
+    max_per_second_ = s.max_per_second;
+    burst_ = std::max<uint32_t>(s.burst, 1);
+    if (s.max_per_second > 0) {
+        int64_t interval = 1'000'000'000 / s.max_per_second;
+        tolerance_ns_ = interval * (burst_ - 1);
+        tat_ = 0;
+        interval_ns_ = interval;
+    } else {
+        interval_ns_ = 0;
+    }
+}
+
+Sampling sampler::get() const {
+    return {one_in_, max_per_second_, burst_};
+}
+
+bool sampler::rate_limit(int64_t interval) {
+    int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                          std::chrono::steady_clock::now().time_since_epoch())
+                          .count();
+    auto tolerance = tolerance_ns_.load(std::memory_order_relaxed);
+    auto tat = tat_.load(std::memory_order_relaxed);
+    int64_t next;
+    do {
+        if (now < tat - tolerance)
+            return false;
+        next = std::max(tat, now) + interval;
+    } while (!tat_.compare_exchange_weak(tat, next, std::memory_order_relaxed));
+    return true;
+}
+
+}  // namespace oxen::log::detail
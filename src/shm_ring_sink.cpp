@@ -0,0 +1,315 @@
+#include <oxen/log/shm_ring_sink.hpp>
+#include <oxen/log/format.hpp>
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace oxen::log {
+
+namespace detail {
+
+    // Layout of the start of the shared memory object; the ring data follows (at offset
+    // sizeof(shm_ring_header)).  head and tail are monotonically increasing byte positions; the
+    // position in the data is the value modulo the capacity.  The writer only modifies head, the
+    // reader only modifies tail.
+    struct shm_ring_header {
+        std::atomic<uint64_t> magic;
+        uint64_t capacity;
+        int64_t writer_pid;
+        alignas(64) std::atomic<uint64_t> head;
+        alignas(64) std::atomic<uint64_t> tail;
+        alignas(64) std::atomic<uint64_t> dropped;
+    };
+    static_assert(std::atomic<uint64_t>::is_always_lock_free);
+
+    // Each record is a record_header followed by the line, padded to a multiple of 8 bytes.  A
+    // length of PAD_RECORD marks the rest of the ring (up to the wrap-around point) as unused.
+    struct record_header {
+        uint32_t length;
+        uint32_t level;
+        int64_t timestamp_ns;
+    };
+    static_assert(sizeof(record_header) == 16);
+
+    constexpr uint64_t RING_MAGIC = 0x676f6c2d6e65786f;  // "oxen-log"
+    constexpr uint32_t PAD_RECORD = 0xffffffff;
+
+    constexpr uint64_t align8(uint64_t n) {
+        return (n + 7) & ~uint64_t{7};
+    }
+
+    shm_ring::~shm_ring() {
+        if (header)
+            munmap(header, map_size);
+        if (fd != -1)
+            close(fd);
+    }
+
+}  // namespace detail
+
+namespace {
+
+    std::string shm_name(std::string_view name) {
+        return "/{}{}"_format(SHM_RING_PREFIX, name);
+    }
+
+    [[noreturn]] void throw_errno(std::string_view what, std::string_view name) {
+        throw std::runtime_error{"Unable to {} shm log ring '{}': {}"_format(
+                what, name, std::strerror(errno))};
+    }
+
+    void map_ring(detail::shm_ring& ring, std::string_view name, size_t size) {
+        void* mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, ring.fd, 0);
+        if (mem == MAP_FAILED)
+            throw_errno("map", name);
+        ring.header = static_cast<detail::shm_ring_header*>(mem);
+        ring.data = static_cast<char*>(mem) + sizeof(detail::shm_ring_header);
+        ring.map_size = size;
+    }
+
+    bool same_file(int fd, const std::string& name) {
+        int fd2 = shm_open(name.c_str(), O_RDONLY, 0);
+        if (fd2 == -1)
+            return false;
+        struct stat a, b;
+        bool same = fstat(fd, &a) == 0 && fstat(fd2, &b) == 0 && a.st_ino == b.st_ino &&
+                    a.st_dev == b.st_dev;
+        close(fd2);
+        return same;
+    }
+
+}  // namespace
+
+ShmRingSink::ShmRingSink(std::string name, size_t capacity) {
+    if (name.empty() || name.find('/') != std::string::npos)
+        throw std::invalid_argument{"Invalid shm log ring name '{}'"_format(name)};
+    uint64_t cap = 4096;
+    while (cap < capacity)
+        cap <<= 1;
+
+    auto path = shm_name(name);
+    // Retry loop: the collector can remove an (abandoned, empty) ring between our open and lock, in
+    // which case we need to start over with a new one.
+    for (int attempt = 0;; attempt++) {
+        if (attempt >= 100)
+            throw std::runtime_error{
+                    "Unable to lock shm log ring '{}': it is in use"_format(name)};
+        if (ring_.fd != -1)
+            close(ring_.fd);
+        ring_.fd = shm_open(path.c_str(), O_RDWR | O_CREAT, 0600);
+        if (ring_.fd == -1)
+            throw_errno("open", name);
+        if (flock(ring_.fd, LOCK_EX | LOCK_NB) != 0) {
+            if (errno != EWOULDBLOCK)
+                throw_errno("lock", name);
+            std::this_thread::sleep_for(std::chrono::milliseconds{10});
+            continue;
+        }
+        if (same_file(ring_.fd, path))
+            break;
+    }
+
+    struct stat st;
+    if (fstat(ring_.fd, &st) != 0)
+        throw_errno("stat", name);
+    if (static_cast<size_t>(st.st_size) > sizeof(detail::shm_ring_header)) {
+        // Existing ring (e.g. from a previous run that the collector hasn't finished draining):
+        // reuse it if valid, with whatever capacity it already has.
+        map_ring(ring_, name, st.st_size);
+        if (ring_.header->magic.load(std::memory_order_acquire) != detail::RING_MAGIC ||
+            ring_.header->capacity + sizeof(detail::shm_ring_header) !=
+                    static_cast<uint64_t>(st.st_size)) {
+            // Not a valid ring (perhaps the writer died while creating it); start over.
+            munmap(ring_.header, ring_.map_size);
+            ring_.header = nullptr;
+        }
+    }
+    if (!ring_.header) {
+        size_t size = sizeof(detail::shm_ring_header) + cap;
+        if (ftruncate(ring_.fd, 0) != 0 || ftruncate(ring_.fd, size) != 0)
+            throw_errno("resize", name);
+        map_ring(ring_, name, size);
+        auto& h = *ring_.header;
+        h.capacity = cap;
+        h.head = 0;
+        h.tail = 0;
+        h.dropped = 0;
+        h.magic.store(detail::RING_MAGIC, std::memory_order_release);
+    }
+    ring_.header->writer_pid = getpid();
+}
+
+uint64_t ShmRingSink::dropped() const {
+    return ring_.header->dropped.load(std::memory_order_relaxed);
+}
+
+void ShmRingSink::sink_it_(const spdlog::details::log_msg& msg) {
+    spdlog::memory_buf_t buf;
+    formatter_->format(msg, buf);
+    std::string_view line{buf.data(), buf.size()};
+    while (!line.empty() && (line.back() == '\n' || line.back() == '\r'))
+        line.remove_suffix(1);
+
+    auto& h = *ring_.header;
+    const uint64_t cap = h.capacity;
+    // Don't let any single record take more than a quarter of the ring
+    if (line.size() > cap / 4 - sizeof(detail::record_header))
+        line = line.substr(0, cap / 4 - sizeof(detail::record_header));
+
+    const uint64_t rec_size = detail::align8(sizeof(detail::record_header) + line.size());
+    const uint64_t head = h.head.load(std::memory_order_relaxed);
+    const uint64_t tail = h.tail.load(std::memory_order_acquire);
+    const uint64_t pos = head % cap;
+    const uint64_t contiguous = cap - pos;
+    const uint64_t needed = rec_size <= contiguous ? rec_size : contiguous + rec_size;
+
+    if (head + needed - tail > cap) {
+        h.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    uint64_t wpos = pos;
+    if (rec_size > contiguous) {
+        // Not enough room before the end of the ring: mark the rest as padding and wrap around.
+        uint32_t pad = detail::PAD_RECORD;
+        std::memcpy(ring_.data + pos, &pad, sizeof(pad));
+        wpos = 0;
+    }
+    detail::record_header rec{
+            static_cast<uint32_t>(line.size()),
+            static_cast<uint32_t>(msg.level),
+            std::chrono::duration_cast<std::chrono::nanoseconds>(msg.time.time_since_epoch())
+                    .count()};
+    std::memcpy(ring_.data + wpos, &rec, sizeof(rec));
+    std::memcpy(ring_.data + wpos + sizeof(rec), line.data(), line.size());
+
+    h.head.store(head + needed, std::memory_order_release);
+}
+
+ShmRingReader::ShmRingReader(std::string name) : name_{std::move(name)} {
+    auto path = shm_name(name_);
+    ring_.fd = shm_open(path.c_str(), O_RDWR, 0);
+    if (ring_.fd == -1)
+        throw_errno("open", name_);
+    struct stat st;
+    if (fstat(ring_.fd, &st) != 0)
+        throw_errno("stat", name_);
+    if (static_cast<size_t>(st.st_size) <= sizeof(detail::shm_ring_header))
+        throw std::runtime_error{"shm log ring '{}' is not initialized"_format(name_)};
+    map_ring(ring_, name_, st.st_size);
+    if (ring_.header->magic.load(std::memory_order_acquire) != detail::RING_MAGIC ||
+        ring_.header->capacity + sizeof(detail::shm_ring_header) !=
+                static_cast<uint64_t>(st.st_size))
+        throw std::runtime_error{"shm log ring '{}' is not initialized"_format(name_)};
+}
+
+size_t ShmRingReader::read(
+        const std::function<void(time_point, Level, std::string_view)>& f, size_t max) {
+    auto& h = *ring_.header;
+    // The ring is written by another process that may have crashed part way through a record or
+    // be misbehaving, so nothing read from it (other than the tail, which only we write) is
+    // trusted: the capacity comes from our own mapping, and everything else is bounds checked.
+    const uint64_t cap = ring_.map_size - sizeof(detail::shm_ring_header);
+    uint64_t tail = h.tail.load(std::memory_order_relaxed);
+    const uint64_t head = h.head.load(std::memory_order_acquire);
+    // Skips everything up to head, counting it as (at least) one dropped message
+    auto skip_corrupt = [&] {
+        tail = head;
+        h.dropped.fetch_add(1, std::memory_order_relaxed);
+    };
+    if (head < tail || head - tail > cap)
+        skip_corrupt();
+    size_t count = 0;
+    while (tail < head && count < max) {
+        const uint64_t pos = tail % cap;
+        const uint64_t contiguous = cap - pos;
+        detail::record_header rec;
+        if (contiguous < sizeof(rec.length)) {
+            skip_corrupt();
+            break;
+        }
+        std::memcpy(&rec.length, ring_.data + pos, sizeof(rec.length));
+        if (rec.length == detail::PAD_RECORD) {
+            if (contiguous > head - tail) {
+                skip_corrupt();
+                break;
+            }
+            tail += contiguous;
+            continue;
+        }
+        if (contiguous < sizeof(rec)) {
+            skip_corrupt();
+            break;
+        }
+        // (The length is checked in this copy, since it's the one we use)
+        std::memcpy(&rec, ring_.data + pos, sizeof(rec));
+        if (rec.length > contiguous - sizeof(rec) ||
+            detail::align8(sizeof(rec) + rec.length) > head - tail) {
+            skip_corrupt();
+            break;
+        }
+        f(time_point{std::chrono::duration_cast<time_point::duration>(
+                  std::chrono::nanoseconds{rec.timestamp_ns})},
+          static_cast<Level>(rec.level),
+          std::string_view{ring_.data + pos + sizeof(rec), rec.length});
+        tail += detail::align8(sizeof(rec) + rec.length);
+        count++;
+    }
+    h.tail.store(tail, std::memory_order_release);
+    return count;
+}
+
+uint64_t ShmRingReader::take_dropped() {
+    return ring_.header->dropped.exchange(0, std::memory_order_relaxed);
+}
+
+bool ShmRingReader::empty() const {
+    return ring_.header->tail.load(std::memory_order_relaxed) ==
+           ring_.header->head.load(std::memory_order_acquire);
+}
+
+bool ShmRingReader::abandoned() const {
+    if (flock(ring_.fd, LOCK_EX | LOCK_NB) != 0)
+        return false;
+    flock(ring_.fd, LOCK_UN);
+    return true;
+}
+
+bool ShmRingReader::remove_if_finished() {
+    if (flock(ring_.fd, LOCK_EX | LOCK_NB) != 0)
+        return false;
+    // We now hold the writer lock, so nothing can start writing to it while we check and remove it
+    // (a writer that opened it just before we unlink will notice it's been replaced and retry).
+    bool removed = false;
+    if (empty())
+        removed = shm_unlink(shm_name(name_).c_str()) == 0;
+    flock(ring_.fd, LOCK_UN);
+    return removed;
+}
+
+std::vector<std::string> list_shm_rings() {
+    std::vector<std::string> names;
+    DIR* dir = opendir("/dev/shm");
+    if (!dir)
+        return names;
+    while (auto* ent = readdir(dir)) {
+        std::string_view fname{ent->d_name};
+        if (fname.size() > SHM_RING_PREFIX.size() &&
+            fname.substr(0, SHM_RING_PREFIX.size()) == SHM_RING_PREFIX)
+            names.emplace_back(fname.substr(SHM_RING_PREFIX.size()));
+    }
+    closedir(dir);
+    return names;
+}
+
+}  // namespace oxen::log
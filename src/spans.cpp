@@ -0,0 +1,200 @@
+#include <oxen/log/spans.hpp>
+#include <oxen/log/format.hpp>
+
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace oxen::log {
+
+namespace {
+
+    struct span_record {
+        const spdlog::logger* cat;
+        const char* name;
+        int64_t start;  // steady_clock nanoseconds
+        int64_t end;
+    };
+
+    // A thread's recorded spans, in a ring buffer.  The buffer is normally only touched by its own
+    // thread, so the mutex is uncontended except while exporting.
+    struct thread_spans {
+        std::mutex mutex;
+        const uint64_t tid;
+        std::vector<span_record> spans;
+        size_t next = 0;  // Where the next span goes once `spans` is full
+
+        thread_spans(uint64_t tid, size_t capacity) : tid{tid} { spans.reserve(capacity); }
+
+        void add(const span_record& r) {
+            std::lock_guard lock{mutex};
+            if (spans.size() < spans.capacity())
+                spans.push_back(r);
+            else if (!spans.empty()) {
+                spans[next] = r;
+                next = (next + 1) % spans.size();
+            }
+        }
+    };
+
+    // All threads' buffers; these are kept (even after their thread exits) until exported.
+    std::mutex buffers_mutex;
+    std::vector<std::shared_ptr<thread_spans>> buffers;
+    uint64_t next_tid = 1;
+    size_t buffer_size = 65536;
+
+    // Protects changes to the spans_enabled_count along with the per-category flags
+    std::mutex enabled_mutex;
+
+    thread_spans& my_spans() {
+        static thread_local std::shared_ptr<thread_spans> mine = [] {
+            std::lock_guard lock{buffers_mutex};
+            return buffers.emplace_back(std::make_shared<thread_spans>(next_tid++, buffer_size));
+        }();
+        return *mine;
+    }
+
+    detail::category_logger& get_cat(const logger_ptr& cat) {
+        auto* cl = dynamic_cast<detail::category_logger*>(cat.get());
+        if (!cl)
+            throw std::invalid_argument{"Spans are only supported on category loggers"};
+        return *cl;
+    }
+
+    // Must be called with enabled_mutex held
+    void set_spans_locked(detail::category_logger& cat, bool enabled) {
+        if (cat.spans.exchange(enabled) != enabled)
+            detail::spans_enabled_count += enabled ? 1 : -1;
+    }
+
+    int64_t steady_ns(std::chrono::steady_clock::time_point t) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count();
+    }
+
+    void write_json_string(std::ostream& out, std::string_view s) {
+        out << '"';
+        for (char c : s) {
+            if (c == '"' || c == '\\')
+                out << '\\' << c;
+            else if (static_cast<unsigned char>(c) < 0x20)
+                out << "\\u{:04x}"_format(static_cast<int>(c));
+            else
+                out << c;
+        }
+        out << '"';
+    }
+
+    // Microseconds with nanosecond precision, as Chrome trace timestamps expect
+    std::string micros(int64_t ns) {
+        return "{}.{:03d}"_format(ns / 1000, ns % 1000);
+    }
+
+}  // namespace
+
+namespace detail {
+
+    void record_span(
+            const spdlog::logger& cat,
+            const char* name,
+            std::chrono::steady_clock::time_point start,
+            std::chrono::steady_clock::time_point end) {
+        my_spans().add({&cat, name, steady_ns(start), steady_ns(end)});
+    }
+
+}  // namespace detail
+
+void set_spans(const logger_ptr& cat, bool enabled) {
+    auto& cl = get_cat(cat);
+    std::lock_guard lock{enabled_mutex};
+    set_spans_locked(cl, enabled);
+}
+
+void set_spans(std::string cat_name, bool enabled) {
+    set_spans(Cat(std::move(cat_name)), enabled);
+}
+
+bool get_spans(const logger_ptr& cat) {
+    return get_cat(cat).spans;
+}
+
+bool get_spans(std::string cat_name) {
+    return get_spans(Cat(std::move(cat_name)));
+}
+
+void reset_spans(bool enabled) {
+    std::lock_guard lock{enabled_mutex};
+    for_each_cat_logger([enabled](const std::string&, spdlog::logger& logger) {
+        if (auto* cl = dynamic_cast<detail::category_logger*>(&logger))
+            set_spans_locked(*cl, enabled);
+    });
+}
+
+void set_span_buffer_size(size_t spans) {
+    std::lock_guard lock{buffers_mutex};
+    buffer_size = spans;
+}
+
+size_t write_chrome_trace(std::ostream& out, bool clear) {
+#ifdef _WIN32
+    const auto pid = _getpid();
+#else
+    const auto pid = getpid();
+#endif
+    std::lock_guard lock{buffers_mutex};
+    size_t count = 0;
+    out << R"({"displayTimeUnit":"ns","traceEvents":[)";
+    for (auto& buf : buffers) {
+        std::lock_guard buf_lock{buf->mutex};
+        // Oldest first, for buffers that have wrapped around
+        for (size_t i = 0; i < buf->spans.size(); i++) {
+            auto& s = buf->spans[(buf->next + i) % buf->spans.size()];
+            out << (count++ ? ",\n" : "\n") << R"({"name":)";
+            write_json_string(out, s.name);
+            out << R"(,"cat":)";
+            write_json_string(out, s.cat->name());
+            out << R"(,"ph":"X","ts":{},"dur":{},"pid":{},"tid":{}}})"_format(
+                    micros(s.start), micros(s.end - s.start), pid, buf->tid);
+        }
+        if (clear) {
+            buf->spans.clear();
+            buf->next = 0;
+        }
+    }
+    out << "\n]}\n";
+
+    if (clear)
+        // Drop the buffers of threads that have exited
+        std::erase_if(buffers, [](const auto& buf) { return buf.use_count() == 1; });
+    return count;
+}
+
+size_t write_chrome_trace(const std::string& filename, bool clear) {
+    std::ofstream out{filename, std::ios::binary};
+    if (!out)
+        throw std::runtime_error{"Unable to open {} for writing"_format(filename)};
+    auto count = write_chrome_trace(out, clear);
+    out.flush();
+    if (!out)
+        throw std::runtime_error{"Failed to write trace to {}"_format(filename)};
+    return count;
+}
+
+void clear_spans() {
+    std::lock_guard lock{buffers_mutex};
+    for (auto& buf : buffers) {
+        std::lock_guard buf_lock{buf->mutex};
+        buf->spans.clear();
+        buf->next = 0;
+    }
+    std::erase_if(buffers, [](const auto& buf) { return buf.use_count() == 1; });
+}
+
+}  // namespace oxen::log
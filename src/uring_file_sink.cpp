@@ -0,0 +1,366 @@
+#include <oxen/log/uring_file_sink.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+
+#include <spdlog/details/os.h>
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace oxen::log {
+
+namespace detail {
+
+    // Minimal io_uring wrapper using the raw system calls (so that we don't need liburing), with
+    // just enough to submit writes and fsyncs from, and reap their completions on, one thread at a
+    // time.
+    struct uring {
+        int fd = -1;
+        void* sq_map = MAP_FAILED;
+        size_t sq_map_size = 0;
+        void* cq_map = MAP_FAILED;
+        size_t cq_map_size = 0;
+        io_uring_sqe* sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+        size_t sqes_size = 0;
+
+        unsigned* sq_tail;
+        unsigned* sq_array;
+        unsigned sq_mask;
+        unsigned sq_entries;
+        unsigned sq_pending = 0;  // SQEs filled in but not yet made visible to the kernel
+
+        unsigned* cq_head;
+        unsigned* cq_tail;
+        unsigned cq_mask;
+        io_uring_cqe* cqes;
+
+        bool fixed_buffers = false;
+
+        ~uring() {
+            if (sqes != MAP_FAILED)
+                munmap(sqes, sqes_size);
+            if (cq_map != MAP_FAILED && cq_map != sq_map)
+                munmap(cq_map, cq_map_size);
+            if (sq_map != MAP_FAILED)
+                munmap(sq_map, sq_map_size);
+            if (fd != -1)
+                close(fd);
+        }
+
+        // Returns a zeroed SQE to fill in; it is submitted by the next call to `submit()`.
+        io_uring_sqe& next_sqe() {
+            unsigned idx = (*sq_tail + sq_pending++) & sq_mask;
+            sq_array[idx] = idx;
+            std::memset(&sqes[idx], 0, sizeof(io_uring_sqe));
+            return sqes[idx];
+        }
+
+        // Returns 0 on success, an errno value on failure.
+        int enter(unsigned to_submit, unsigned min_complete, unsigned flags) {
+            int rc;
+            do {
+                rc = syscall(
+                        __NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0);
+            } while (rc < 0 && errno == EINTR);
+            return rc < 0 ? errno : 0;
+        }
+
+        int submit() {
+            std::atomic_ref{*sq_tail}.fetch_add(sq_pending, std::memory_order_release);
+            unsigned n = sq_pending;
+            sq_pending = 0;
+            return enter(n, 0, 0);
+        }
+
+        int wait() { return enter(0, 1, IORING_ENTER_GETEVENTS); }
+    };
+
+}  // namespace detail
+
+namespace {
+
+    constexpr uint64_t FSYNC_TAG = ~uint64_t{0};
+
+    // Don't submit writes smaller than this (except when flushing)
+    constexpr size_t MIN_WRITE = 4096;
+
+    template <typename T = void>
+    T* offset_ptr(void* base, uint32_t off) {
+        return reinterpret_cast<T*>(static_cast<char*>(base) + off);
+    }
+
+}  // namespace
+
+UringFileSink::UringFileSink(std::string filename, size_t buffer_size, size_t buffers) :
+        filename_{std::move(filename)}, buffer_size_{std::max<size_t>(buffer_size, 4096)} {
+    spdlog::details::os::create_dir(spdlog::details::os::dir_name(filename_));
+    fd_ = open(filename_.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (fd_ == -1)
+        throw spdlog::spdlog_ex{"Failed opening file " + filename_ + " for writing", errno};
+    // We write at explicit offsets (so that writes completing out of order are fine) starting from
+    // the current end of the file.
+    struct stat st;
+    if (fstat(fd_, &st) == 0)
+        offset_ = st.st_size;
+
+    buffers_.resize(std::max<size_t>(buffers, 2));
+    for (auto& buf : buffers_)
+        buf.data = std::make_unique<char[]>(buffer_size_);
+
+    if (!setup_ring(buffers_.size())) {
+        close(fd_);
+        fd_ = -1;
+        buffers_.clear();
+        fallback_.emplace();
+        fallback_->open(filename_);
+    }
+}
+
+UringFileSink::~UringFileSink() {
+    std::lock_guard lock{mutex_};
+    if (ring_) {
+        try {
+            if (buffers_[current_].size > 0)
+                submit_current();
+        } catch (...) {
+        }
+        while (in_flight_ > 0) {
+            auto before = in_flight_;
+            try {
+                reap(true);
+            } catch (...) {
+            }
+            if (in_flight_ == before)
+                break;
+        }
+    }
+    ring_.reset();
+    if (fd_ != -1)
+        close(fd_);
+}
+
+bool UringFileSink::setup_ring(size_t buffers) {
+    io_uring_params params{};
+    int fd = syscall(__NR_io_uring_setup, static_cast<unsigned>(buffers * 2 + 2), &params);
+    if (fd < 0)
+        return false;
+    auto r = std::make_unique<detail::uring>();
+    r->fd = fd;
+
+    r->sq_map_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    r->cq_map_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single_map = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_map)
+        r->sq_map_size = r->cq_map_size = std::max(r->sq_map_size, r->cq_map_size);
+
+    r->sq_map = mmap(
+            nullptr,
+            r->sq_map_size,
+            PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE,
+            fd,
+            IORING_OFF_SQ_RING);
+    if (r->sq_map == MAP_FAILED)
+        return false;
+    r->cq_map = single_map ? r->sq_map
+                           : mmap(nullptr,
+                                  r->cq_map_size,
+                                  PROT_READ | PROT_WRITE,
+                                  MAP_SHARED | MAP_POPULATE,
+                                  fd,
+                                  IORING_OFF_CQ_RING);
+    if (r->cq_map == MAP_FAILED)
+        return false;
+    r->sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    r->sqes = static_cast<io_uring_sqe*>(mmap(
+            nullptr,
+            r->sqes_size,
+            PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE,
+            fd,
+            IORING_OFF_SQES));
+    if (r->sqes == MAP_FAILED)
+        return false;
+
+    r->sq_tail = offset_ptr<unsigned>(r->sq_map, params.sq_off.tail);
+    r->sq_array = offset_ptr<unsigned>(r->sq_map, params.sq_off.array);
+    r->sq_mask = *offset_ptr<unsigned>(r->sq_map, params.sq_off.ring_mask);
+    r->sq_entries = params.sq_entries;
+    r->cq_head = offset_ptr<unsigned>(r->cq_map, params.cq_off.head);
+    r->cq_tail = offset_ptr<unsigned>(r->cq_map, params.cq_off.tail);
+    r->cq_mask = *offset_ptr<unsigned>(r->cq_map, params.cq_off.ring_mask);
+    r->cqes = offset_ptr<io_uring_cqe>(r->cq_map, params.cq_off.cqes);
+
+    // Registering the buffers saves the kernel from mapping them on every write, but can fail (for
+    // instance because of RLIMIT_MEMLOCK), in which case we just use ordinary writes.
+    std::vector<iovec> iovs;
+    for (auto& buf : buffers_)
+        iovs.push_back({buf.data.get(), buffer_size_});
+    r->fixed_buffers =
+            syscall(__NR_io_uring_register,
+                    fd,
+                    IORING_REGISTER_BUFFERS,
+                    iovs.data(),
+                    static_cast<unsigned>(iovs.size())) == 0;
+
+    ring_ = std::move(r);
+    return true;
+}
+
+void UringFileSink::sink_it_(const spdlog::details::log_msg& msg) {
+    line_.clear();
+    formatter_->format(msg, line_);
+    if (fallback_) {
+        fallback_->write(line_);
+        return;
+    }
+
+    reap(false);
+    if (buffers_[current_].size + line_.size() > buffer_size_) {
+        if (buffers_[current_].size > 0)
+            submit_current();
+        if (line_.size() > buffer_size_) {
+            write_direct(line_.data(), line_.size());
+            return;
+        }
+    }
+    auto& buf = buffers_[current_];
+    std::memcpy(buf.data.get() + buf.size, line_.data(), line_.size());
+    buf.size += line_.size();
+
+    // Once we have a stdio-buffer's worth, write it if the kernel is idle; otherwise keep filling
+    // the buffer until the write in progress finishes, so that writes get larger as the volume
+    // goes up.
+    if (in_flight_ == 0 && buf.size >= MIN_WRITE)
+        submit_current();
+}
+
+void UringFileSink::flush_() {
+    if (fallback_) {
+        fallback_->flush();
+        return;
+    }
+    reap(false);
+    submit_current(true);
+}
+
+void UringFileSink::submit_current(bool then_sync) {
+    auto& ring = *ring_;
+    const unsigned needed = 1 + then_sync;
+    while (in_flight_ + needed > ring.sq_entries)
+        reap(true);
+
+    auto& buf = buffers_[current_];
+    const bool write = buf.size > 0;
+    if (write) {
+        auto& sqe = ring.next_sqe();
+        sqe.opcode = ring.fixed_buffers ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+        sqe.fd = fd_;
+        sqe.addr = reinterpret_cast<uint64_t>(buf.data.get());
+        sqe.len = buf.size;
+        sqe.off = buf.offset = offset_;
+        if (ring.fixed_buffers)
+            sqe.buf_index = current_;
+        sqe.user_data = current_;
+        if (then_sync)
+            sqe.flags = IOSQE_IO_LINK;
+        offset_ += buf.size;
+        buf.in_flight = true;
+        in_flight_++;
+    }
+    // The fsync is linked to the write above, and drains (i.e. waits for) any earlier writes
+    if (then_sync)
+        queue_sync();
+    if (int err = ring.submit())
+        throw spdlog::spdlog_ex{"Failed to submit write to " + filename_, err};
+
+    if (write) {
+        current_ = (current_ + 1) % buffers_.size();
+        while (buffers_[current_].in_flight)
+            reap(true);
+    }
+}
+
+void UringFileSink::queue_sync() {
+    auto& sqe = ring_->next_sqe();
+    sqe.opcode = IORING_OP_FSYNC;
+    sqe.fd = fd_;
+    sqe.fsync_flags = IORING_FSYNC_DATASYNC;
+    sqe.flags = IOSQE_IO_DRAIN;
+    sqe.user_data = FSYNC_TAG;
+    in_flight_++;
+}
+
+void UringFileSink::reap(bool wait) {
+    auto& ring = *ring_;
+    unsigned head = *ring.cq_head;
+    if (wait && in_flight_ > 0 &&
+        head == std::atomic_ref{*ring.cq_tail}.load(std::memory_order_acquire))
+        if (int err = ring.wait())
+            throw spdlog::spdlog_ex{"Failed waiting for writes to " + filename_, err};
+
+    int error = 0;
+    bool resync = false;
+    const unsigned tail = std::atomic_ref{*ring.cq_tail}.load(std::memory_order_acquire);
+    for (; head != tail; head++) {
+        const auto& cqe = ring.cqes[head & ring.cq_mask];
+        in_flight_--;
+        if (cqe.user_data == FSYNC_TAG) {
+            // A cancelled fsync means its linked write failed, which we report below, or completed
+            // short, in which case we finish the write below and then have to redo the fsync.
+            if (cqe.res == -ECANCELED)
+                resync = true;
+            else if (cqe.res < 0)
+                error = -cqe.res;
+            continue;
+        }
+        auto& buf = buffers_[cqe.user_data];
+        if (cqe.res < 0)
+            error = -cqe.res;
+        else if (static_cast<size_t>(cqe.res) < buf.size) {
+            // Short write (e.g. the disk filled up): finish it synchronously.
+            auto done = static_cast<size_t>(cqe.res);
+            auto rest = buf.size - done;
+            auto n = pwrite(fd_, buf.data.get() + done, rest, buf.offset + done);
+            if (n != static_cast<ssize_t>(rest))
+                error = n < 0 ? errno : ENOSPC;
+        }
+        buf.in_flight = false;
+        buf.size = 0;
+    }
+    std::atomic_ref{*ring.cq_head}.store(head, std::memory_order_release);
+
+    if (error)
+        throw spdlog::spdlog_ex{"Failed writing to file " + filename_, error};
+
+    // (There is room for this: we just reaped the cancelled fsync)
+    if (resync) {
+        queue_sync();
+        if (int err = ring.submit())
+            throw spdlog::spdlog_ex{"Failed to submit fsync of " + filename_, err};
+    }
+}
+
+void UringFileSink::write_direct(const char* data, size_t size) {
+    while (size > 0) {
+        auto n = pwrite(fd_, data, size, offset_);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            throw spdlog::spdlog_ex{"Failed writing to file " + filename_, errno};
+        }
+        data += n;
+        size -= n;
+        offset_ += n;
+    }
+}
+
+}  // namespace oxen::log
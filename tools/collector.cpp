@@ -0,0 +1,155 @@
+// oxen-log-collector: drains the shared memory log rings written by ShmRingSink in one or more
+// local processes, merges them by timestamp, and writes them to a single size-rotated log file.
+
+#include <oxen/log/format.hpp>
+#include <oxen/log/shm_ring_sink.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <csignal>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <string>
+#include <memory>
+#include <thread>
+
+#include <spdlog/sinks/rotating_file_sink.h>
+
+namespace collector {
+
+using namespace oxen::log::literals;
+using namespace std::literals;
+using oxen::log::ShmRingReader;
+using clock = std::chrono::system_clock;
+
+std::atomic<bool> running{true};
+
+struct record {
+    std::string ring;
+    oxen::log::Level level;
+    std::string line;
+};
+
+int usage(const char* prog, std::string_view error = "") {
+    if (!error.empty())
+        std::cerr << error << "\n\n";
+    std::cerr << "Usage: " << prog << R"( OUTPUT [OPTIONS]
+
+Collects log output from local processes logging to shared memory rings (ShmRingSink), merges it
+in timestamp order, and writes it to OUTPUT.
+
+Options:
+    --max-size=BYTES   Rotate OUTPUT when it reaches this size (default 100000000).
+    --max-files=N      Number of rotated files to keep (default 5).
+    --interval=MS      How often to poll for new log messages (default 50).
+    --delay=MS         How long to hold messages to allow merging of messages from processes that
+                       are polled later (default 200).
+)";
+    return 1;
+}
+
+int run(int argc, char* argv[]) {
+    if (argc < 2)
+        return usage(argv[0]);
+
+    std::string output;
+    size_t max_size = 100'000'000, max_files = 5;
+    auto interval = 50ms, delay = 200ms;
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg{argv[i]};
+        auto value = [&](std::string_view opt) -> std::optional<int64_t> {
+            if (arg.substr(0, opt.size()) != opt)
+                return std::nullopt;
+            return std::stoll(std::string{arg.substr(opt.size())});
+        };
+        try {
+            if (auto v = value("--max-size="))
+                max_size = *v;
+            else if (auto v = value("--max-files="))
+                max_files = *v;
+            else if (auto v = value("--interval="))
+                interval = std::chrono::milliseconds{*v};
+            else if (auto v = value("--delay="))
+                delay = std::chrono::milliseconds{*v};
+            else if (arg.substr(0, 2) == "--" || !output.empty())
+                return usage(argv[0], "Invalid argument: {}"_format(arg));
+            else
+                output = arg;
+        } catch (const std::exception&) {
+            return usage(argv[0], "Invalid argument: {}"_format(arg));
+        }
+    }
+    if (output.empty())
+        return usage(argv[0], "No output file given");
+
+    spdlog::sinks::rotating_file_sink_st out{output, max_size, max_files};
+    out.set_pattern("%v");
+    auto write = [&](std::string_view line) {
+        out.log(spdlog::details::log_msg{
+                spdlog::source_loc{}, "", spdlog::level::info, {line.data(), line.size()}});
+    };
+
+    std::signal(SIGINT, [](int) { running = false; });
+    std::signal(SIGTERM, [](int) { running = false; });
+
+    std::map<std::string, std::unique_ptr<ShmRingReader>> rings;
+    // Messages waiting to be written, sorted by timestamp.  We hold messages for `delay` so that a
+    // message from one process doesn't get written before an earlier one from another process that
+    // we haven't polled yet.
+    std::multimap<clock::time_point, record> pending;
+
+    while (true) {
+        bool stopping = !running;
+
+        for (auto& name : oxen::log::list_shm_rings()) {
+            if (rings.count(name))
+                continue;
+            try {
+                rings.emplace(name, std::make_unique<ShmRingReader>(name));
+            } catch (const std::exception&) {
+                // Probably being created right now; we'll try again next time around.
+            }
+        }
+
+        for (auto it = rings.begin(); it != rings.end();) {
+            auto& [name, reader] = *it;
+            reader->read([&](clock::time_point t, oxen::log::Level lvl, std::string_view line) {
+                pending.emplace(t, record{name, lvl, std::string{line}});
+            });
+            if (auto dropped = reader->take_dropped())
+                pending.emplace(
+                        clock::now(),
+                        record{name,
+                               oxen::log::Level::warn,
+                               "*** {} log message(s) dropped: ring was full ***"_format(dropped)});
+            if (reader->remove_if_finished())
+                it = rings.erase(it);
+            else
+                ++it;
+        }
+
+        auto cutoff = stopping ? clock::time_point::max() : clock::now() - delay;
+        auto end = pending.upper_bound(cutoff);
+        for (auto it = pending.begin(); it != end; ++it)
+            write("[{}] {}"_format(it->second.ring, it->second.line));
+        pending.erase(pending.begin(), end);
+        out.flush();
+
+        if (stopping)
+            break;
+        std::this_thread::sleep_for(interval);
+    }
+    return 0;
+}
+
+}  // namespace collector
+
+int main(int argc, char* argv[]) {
+    try {
+        return collector::run(argc, argv);
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 2;
+    }
+}
@@ -0,0 +1,335 @@
+// oxen-log-grep: fast, parallel search of (uncompressed) oxen log files written with the default
+// log pattern, with level, category and time range filters.
+//
+// Files are memory-mapped and split into one chunk per thread at line boundaries.  When a search
+// string is given each chunk is scanned for it directly (with SSE2/AVX2 kernels on x86-64), and
+// only the lines containing a match are parsed for the other filters; otherwise each line's
+// "[YYYY-MM-DD HH:MM:SS] [+elapsed] [category:level|file:line]" prefix is parsed and filtered
+// without any regex matching.
+
+#include <oxen/log/format.hpp>
+#include <oxen/log/level.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define OXEN_LOG_GREP_X86
+#endif
+
+namespace grep {
+
+using namespace oxen::log::literals;
+using oxen::log::Level;
+constexpr auto npos = std::string_view::npos;
+
+// Substring search kernels.  These use the approach of comparing the first and last characters of
+// the needle against a whole vector of candidate positions at once, and only doing a full
+// comparison at positions where both match.
+
+#ifdef OXEN_LOG_GREP_X86
+__attribute__((target("avx2"))) size_t find_avx2(std::string_view hay, std::string_view needle) {
+    const size_t n = needle.size();
+    const __m256i first = _mm256_set1_epi8(needle.front());
+    const __m256i last = _mm256_set1_epi8(needle.back());
+    size_t i = 0;
+    for (; i + n - 1 + 32 <= hay.size(); i += 32) {
+        auto bf = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(hay.data() + i));
+        auto bl = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(hay.data() + i + n - 1));
+        auto mask = static_cast<uint32_t>(_mm256_movemask_epi8(
+                _mm256_and_si256(_mm256_cmpeq_epi8(bf, first), _mm256_cmpeq_epi8(bl, last))));
+        for (; mask; mask &= mask - 1) {
+            auto pos = i + __builtin_ctz(mask);
+            if (std::memcmp(hay.data() + pos + 1, needle.data() + 1, n - 2) == 0)
+                return pos;
+        }
+    }
+    auto r = hay.substr(i).find(needle);
+    return r == npos ? npos : i + r;
+}
+
+size_t find_sse2(std::string_view hay, std::string_view needle) {
+    const size_t n = needle.size();
+    const __m128i first = _mm_set1_epi8(needle.front());
+    const __m128i last = _mm_set1_epi8(needle.back());
+    size_t i = 0;
+    for (; i + n - 1 + 16 <= hay.size(); i += 16) {
+        auto bf = _mm_loadu_si128(reinterpret_cast<const __m128i*>(hay.data() + i));
+        auto bl = _mm_loadu_si128(reinterpret_cast<const __m128i*>(hay.data() + i + n - 1));
+        auto mask = static_cast<uint32_t>(_mm_movemask_epi8(
+                _mm_and_si128(_mm_cmpeq_epi8(bf, first), _mm_cmpeq_epi8(bl, last))));
+        for (; mask; mask &= mask - 1) {
+            auto pos = i + __builtin_ctz(mask);
+            if (std::memcmp(hay.data() + pos + 1, needle.data() + 1, n - 2) == 0)
+                return pos;
+        }
+    }
+    auto r = hay.substr(i).find(needle);
+    return r == npos ? npos : i + r;
+}
+
+const bool have_avx2 = __builtin_cpu_supports("avx2");
+#endif
+
+// Returns the position of the first occurrence of `needle` in `hay`, or npos.
+size_t find(std::string_view hay, std::string_view needle) {
+    if (needle.size() == 1) {
+        auto* p = static_cast<const char*>(std::memchr(hay.data(), needle[0], hay.size()));
+        return p ? p - hay.data() : npos;
+    }
+#ifdef OXEN_LOG_GREP_X86
+    if (needle.size() > 1)
+        return have_avx2 ? find_avx2(hay, needle) : find_sse2(hay, needle);
+#endif
+    return hay.find(needle);
+}
+
+struct filters {
+    std::string_view pattern;
+    std::optional<Level> min_level;
+    std::vector<std::string> categories;
+    std::string from, to;
+    bool count_only = false;
+
+    bool need_parse() const {
+        return min_level || !categories.empty() || !from.empty() || !to.empty();
+    }
+
+    // Applies the level/category/time filters to a line.  Lines that don't look like default
+    // pattern log lines never pass any of these filters.
+    bool matches(std::string_view line) const {
+        if (!need_parse())
+            return true;
+        if (line.size() < 22 || line[0] != '[' || line[20] != ']')
+            return false;
+        auto ts = line.substr(1, 19);
+        if (!from.empty() && ts.substr(0, from.size()) < from)
+            return false;
+        if (!to.empty() && ts.substr(0, to.size()) > to)
+            return false;
+        if (!min_level && categories.empty())
+            return true;
+
+        auto p = line.find("] [", 21);
+        if (p == npos)
+            return false;
+        auto rest = line.substr(p + 3);
+        auto colon = rest.find(':');
+        auto bar = rest.find('|');
+        if (colon == npos || bar == npos || bar < colon)
+            return false;
+        if (!categories.empty() &&
+            std::find(categories.begin(), categories.end(), rest.substr(0, colon)) ==
+                    categories.end())
+            return false;
+        if (min_level && !level_ok(rest.substr(colon + 1, bar - colon - 1)))
+            return false;
+        return true;
+    }
+
+    // Returns true if `name` (as written by the %l pattern flag) is at or above min_level.  This
+    // avoids level_from_string, which would allocate (and throw on non-level text) for every line.
+    bool level_ok(std::string_view name) const {
+        for (int l = static_cast<int>(*min_level); l < static_cast<int>(Level::off); l++) {
+            auto lname = spdlog::level::to_string_view(static_cast<Level>(l));
+            if (name == std::string_view{lname.data(), lname.size()})
+                return true;
+        }
+        return false;
+    }
+};
+
+struct chunk_result {
+    std::string output;
+    size_t count = 0;
+};
+
+void scan(std::string_view chunk, const filters& f, std::string_view prefix, chunk_result& res) {
+    auto emit = [&](std::string_view line) {
+        res.count++;
+        if (!f.count_only) {
+            res.output.append(prefix);
+            res.output.append(line);
+            res.output.push_back('\n');
+        }
+    };
+
+    size_t pos = 0;
+    while (pos < chunk.size()) {
+        size_t start = pos;
+        if (!f.pattern.empty()) {
+            auto hit = find(chunk.substr(pos), f.pattern);
+            if (hit == npos)
+                break;
+            hit += pos;
+            auto nl = chunk.rfind('\n', hit);
+            start = nl == npos ? 0 : nl + 1;
+        }
+        auto* end_p = static_cast<const char*>(
+                std::memchr(chunk.data() + start, '\n', chunk.size() - start));
+        size_t end = end_p ? end_p - chunk.data() : chunk.size();
+        auto line = chunk.substr(start, end - start);
+        if (f.matches(line))
+            emit(line);
+        pos = end + 1;
+    }
+}
+
+// Returns the number of matching lines, or nullopt if the file could not be read.
+std::optional<size_t> grep_file(
+        const std::string& path, const filters& f, unsigned threads, bool show_name) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        std::cerr << "{}: {}\n"_format(path, std::strerror(errno));
+        return std::nullopt;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        std::cerr << "{}: {}\n"_format(path, std::strerror(errno));
+        close(fd);
+        return std::nullopt;
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        if (f.count_only)
+            std::cout << "{}0\n"_format(show_name ? path + ":" : "");
+        return 0;
+    }
+    size_t size = st.st_size;
+    auto* data = static_cast<const char*>(mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0));
+    close(fd);
+    if (data == MAP_FAILED) {
+        std::cerr << "{}: {}\n"_format(path, std::strerror(errno));
+        return std::nullopt;
+    }
+    madvise(const_cast<char*>(data), size, MADV_SEQUENTIAL);
+    std::string_view file{data, size};
+
+    // Split into chunks at line boundaries; small files aren't worth splitting much.
+    threads = std::max<size_t>(1, std::min<size_t>(threads, size / (1 << 20)));
+    std::vector<std::string_view> chunks;
+    size_t pos = 0;
+    for (unsigned i = 0; i < threads && pos < size; i++) {
+        size_t end = i + 1 == threads ? size : std::max(pos, size / threads * (i + 1));
+        if (end < size) {
+            auto nl = file.find('\n', end);
+            end = nl == npos ? size : nl + 1;
+        }
+        chunks.push_back(file.substr(pos, end - pos));
+        pos = end;
+    }
+
+    std::string prefix = show_name ? path + ":" : "";
+    std::vector<chunk_result> results(chunks.size());
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < chunks.size(); i++)
+        workers.emplace_back(scan, chunks[i], std::cref(f), prefix, std::ref(results[i]));
+    scan(chunks[0], f, prefix, results[0]);
+    for (auto& w : workers)
+        w.join();
+    munmap(const_cast<char*>(data), size);
+
+    size_t count = 0;
+    for (auto& r : results) {
+        count += r.count;
+        std::fwrite(r.output.data(), 1, r.output.size(), stdout);
+    }
+    if (f.count_only)
+        std::cout << "{}{}\n"_format(prefix, count);
+    return count;
+}
+
+int usage(const char* prog, std::string_view error = "") {
+    if (!error.empty())
+        std::cerr << error << "\n\n";
+    std::cerr << "Usage: " << prog << R"( [OPTIONS] [PATTERN] FILE [FILE ...]
+
+Prints lines of oxen log files (using the default log pattern) containing the fixed string PATTERN
+(if given) and matching all of the given filters.
+
+Options:
+    --level=LEVEL           Only lines at LEVEL or above (trace, debug, info, warn, error, critical)
+    --cat=CAT1,CAT2,...     Only lines from the given categories
+    --from="YYYY-MM-DD HH:MM:SS"
+                            Only lines at or after this time; may be truncated, e.g. "2024-03-01 14"
+    --to="YYYY-MM-DD HH:MM:SS"
+                            Only lines at or before this time; may be truncated
+    --threads=N             Number of threads to use (default: number of CPUs)
+    -c, --count             Only print the number of matching lines
+    -e PATTERN              Use PATTERN as the search string (for patterns starting with -)
+)";
+    return 2;
+}
+
+int run(int argc, char* argv[]) {
+    filters f;
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::string> args;
+    std::optional<std::string> pattern;
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg{argv[i]};
+        try {
+            if (arg.substr(0, 8) == "--level=")
+                f.min_level = oxen::log::level_from_string(std::string{arg.substr(8)});
+            else if (arg.substr(0, 6) == "--cat=") {
+                auto list = arg.substr(6);
+                while (!list.empty()) {
+                    auto comma = list.find(',');
+                    f.categories.emplace_back(list.substr(0, comma));
+                    list.remove_prefix(comma == npos ? list.size() : comma + 1);
+                }
+            } else if (arg.substr(0, 7) == "--from=")
+                f.from = arg.substr(7);
+            else if (arg.substr(0, 5) == "--to=")
+                f.to = arg.substr(5);
+            else if (arg.substr(0, 10) == "--threads=")
+                threads = std::max(1, std::stoi(std::string{arg.substr(10)}));
+            else if (arg == "-c" || arg == "--count")
+                f.count_only = true;
+            else if (arg == "-e" && i + 1 < argc)
+                pattern = argv[++i];
+            else if (arg.size() > 1 && arg[0] == '-')
+                return usage(argv[0], "Invalid argument: {}"_format(arg));
+            else
+                args.emplace_back(arg);
+        } catch (const std::exception&) {
+            return usage(argv[0], "Invalid argument: {}"_format(arg));
+        }
+    }
+    if (!pattern && args.size() >= 2) {
+        pattern = std::move(args.front());
+        args.erase(args.begin());
+    }
+    if (args.empty())
+        return usage(argv[0], "No files given");
+    if (pattern)
+        f.pattern = *pattern;
+
+    // Exit status follows grep: 0 if anything matched, 1 if nothing did, 2 on error.
+    bool error = false;
+    size_t matched = 0;
+    for (auto& file : args) {
+        if (auto count = grep_file(file, f, threads, args.size() > 1))
+            matched += *count;
+        else
+            error = true;
+    }
+    return error ? 2 : matched ? 0 : 1;
+}
+
+}  // namespace grep
+
+int main(int argc, char* argv[]) {
+    return grep::run(argc, argv);
+}
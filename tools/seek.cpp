@@ -0,0 +1,92 @@
+// oxen-log-seek: prints the lines of a compressed, indexed log file (as written by
+// CompressedFileSink) within a time range and/or for given categories, decompressing only the parts
+// of the file that can contain matching lines.
+
+#include <oxen/log/compressed_file_sink.hpp>
+#include <oxen/log/format.hpp>
+
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+namespace seek {
+
+using namespace oxen::log::literals;
+using oxen::log::CompressedLogReader;
+
+int usage(const char* prog, std::string_view error = "") {
+    if (!error.empty())
+        std::cerr << error << "\n\n";
+    std::cerr << "Usage: " << prog << R"( FILE.gz [OPTIONS]
+
+Prints matching lines from a compressed, time-indexed oxen log file.
+
+Options:
+    --from="YYYY-MM-DD HH:MM:SS"   Only print lines at or after this (local) time.
+    --to="YYYY-MM-DD HH:MM:SS"     Only print lines at or before this (local) time.
+    --cat=CAT1,CAT2,...            Only print lines from the given categories.
+    --stats                        Print the number of frames decompressed to stderr.
+)";
+    return 1;
+}
+
+std::optional<CompressedLogReader::time_point> parse_time(std::string_view s) {
+    std::tm tm{};
+    std::istringstream in{std::string{s}};
+    in >> std::get_time(&tm, "%Y-%m-%d %H:%M:%S");
+    if (in.fail())
+        return std::nullopt;
+    tm.tm_isdst = -1;
+    return std::chrono::system_clock::from_time_t(std::mktime(&tm));
+}
+
+int run(int argc, char* argv[]) {
+    std::string file;
+    std::optional<CompressedLogReader::time_point> from, to;
+    std::vector<std::string> cats;
+    bool stats = false;
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg{argv[i]};
+        if (arg.substr(0, 7) == "--from=") {
+            if (!(from = parse_time(arg.substr(7))))
+                return usage(argv[0], "Invalid time: {}"_format(arg));
+        } else if (arg.substr(0, 5) == "--to=") {
+            if (!(to = parse_time(arg.substr(5))))
+                return usage(argv[0], "Invalid time: {}"_format(arg));
+        } else if (arg.substr(0, 6) == "--cat=") {
+            auto list = arg.substr(6);
+            while (!list.empty()) {
+                auto comma = list.find(',');
+                cats.emplace_back(list.substr(0, comma));
+                list.remove_prefix(comma == std::string_view::npos ? list.size() : comma + 1);
+            }
+        } else if (arg == "--stats") {
+            stats = true;
+        } else if (arg.substr(0, 2) == "--" || !file.empty()) {
+            return usage(argv[0], "Invalid argument: {}"_format(arg));
+        } else {
+            file = arg;
+        }
+    }
+    if (file.empty())
+        return usage(argv[0]);
+
+    CompressedLogReader reader{file};
+    auto frames = reader.read(
+            [](std::string_view line) { std::cout << line << '\n'; }, from, to, cats);
+    if (stats)
+        std::cerr << "Decompressed {} of {} frames\n"_format(frames, reader.frames().size());
+    return 0;
+}
+
+}  // namespace seek
+
+int main(int argc, char* argv[]) {
+    try {
+        return seek::run(argc, argv);
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 2;
+    }
+}